@@ -0,0 +1,282 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Project-Includes
+#include "akonadi_incidence_store.h"
+#include "akonadi_write_queue.h"
+#include "collection_selector.h"
+#include "events_config.h"
+
+//KDE-Includes
+#include <KDebug>
+#include <Akonadi/ItemFetchJob>
+#include <Akonadi/ItemFetchScope>
+#include <Akonadi/Monitor>
+#include <kcal/event.h>
+#include <kcal/todo.h>
+
+//Qt
+#include <QStringList>
+
+using namespace Akonadi;
+
+AkonadiIncidenceStore::AkonadiIncidenceStore( QObject * parent ) : IncidenceStore( parent ), configured( false ), eventCollectionId( 0 ), todoCollectionId( 0 ), searchAllCollections( true ), fetchFailed( false ), listing( false ) {
+    monitor = new Monitor( this );
+    monitor->itemFetchScope().fetchFullPayload( true );
+
+    connect( monitor, SIGNAL( itemAdded(Akonadi::Item,Akonadi::Collection) ), this, SLOT( monitorItemAdded(Akonadi::Item,Akonadi::Collection) ) );
+    connect( monitor, SIGNAL( itemChanged(Akonadi::Item,QSet<QByteArray>) ), this, SLOT( monitorItemChanged(Akonadi::Item,QSet<QByteArray>) ) );
+    connect( monitor, SIGNAL( itemMoved(Akonadi::Item,Akonadi::Collection,Akonadi::Collection) ), this, SLOT( monitorItemMoved(Akonadi::Item,Akonadi::Collection,Akonadi::Collection) ) );
+    connect( monitor, SIGNAL( itemRemoved(Akonadi::Item) ), this, SLOT( monitorItemRemoved(Akonadi::Item) ) );
+
+    writeQueue = new AkonadiWriteQueue( this );
+
+    connect( writeQueue, SIGNAL( finished(int,Akonadi::Item,bool) ), this, SIGNAL( writeFinished(int,Akonadi::Item,bool) ) );
+}
+
+void AkonadiIncidenceStore::configure( const KConfigGroup & config ) {
+    todoCollectionId = config.readEntry( CONFIG_TODO_COLLECTION, (Collection::Id)0 );
+    eventCollectionId = config.readEntry( CONFIG_EVENT_COLLECTION, (Collection::Id)0 );
+    searchCollectionIds = config.readEntry( CONFIG_SEARCH_COLLECTIONS, QList<Collection::Id>() );
+    searchAllCollections = config.readEntry( CONFIG_SEARCH_ALL_COLLECTIONS, searchCollectionIds.isEmpty() ); // Earlier versions saved empty list for all
+
+    // Source is known from configuration before collections are received, so saved items may be used right away
+    if ( searchAllCollections ) {
+        configuredSource = QLatin1String( "akonadi:all" );
+    } else {
+        QStringList ids;
+
+        foreach ( Collection::Id id, searchCollectionIds )
+            ids.append( QString::number( id ) );
+
+        ids.sort();
+
+        configuredSource = QLatin1String( "akonadi:" ) + ids.join( QLatin1String( "," ) );
+    }
+
+    CollectionSelector * selector = new CollectionSelector( this );
+    connect( selector, SIGNAL( collectionsReceived(CollectionSelector &) ), this, SLOT( collectionsReceived(CollectionSelector &) ) );
+    selector->receiveCollections();
+}
+
+void AkonadiIncidenceStore::collectionsReceived( CollectionSelector & selector ) {
+    todoCollection = selector.selectTodoCollection( todoCollectionId );
+    eventCollection = selector.selectEventCollection( eventCollectionId );
+
+    setCollections( searchAllCollections ? selector.calendarCollections() : selector.selectCalendarCollections( searchCollectionIds ) );
+
+    selector.deleteLater(); // No need to store it in memory anymore
+}
+
+void AkonadiIncidenceStore::setCollections( const Collection::List & newCollections ) {
+    abortFetch();
+
+    foreach ( const Collection & collection, collections )
+        monitor->setCollectionMonitored( collection, false );
+
+    collections.clear();
+
+    foreach ( const Collection & collection, newCollections ) {
+        if ( !collection.isValid() )
+            continue;
+
+        collections.append( collection );
+        monitor->setCollectionMonitored( collection, true );
+    }
+
+    configured = true;
+
+    emit reset();
+}
+
+void AkonadiIncidenceStore::fetch( const QHash<Item::Id, int> & revisions ) {
+    if ( !fetchJobs.isEmpty() ) // Already fetching
+        return;
+
+    fetchFailed = false;
+    knownRevisions = revisions;
+    changedItems.clear();
+    listing = !knownRevisions.isEmpty(); // List revisions first and then fetch only changed items
+
+    ItemFetchScope scope;
+    scope.fetchFullPayload( !listing );
+
+    // Fetch all collections concurrently, delivering items as they arrive
+    foreach ( const Collection & collection, collections ) {
+        ItemFetchJob * job = new ItemFetchJob( collection, this );
+        job->setFetchScope( scope );
+
+        connect( job, SIGNAL( itemsReceived(Akonadi::Item::List) ), this, SLOT( fetchedItemsReceived(Akonadi::Item::List) ) );
+        connect( job, SIGNAL( result(KJob *) ), this, SLOT( fetchResult(KJob *) ) );
+
+        fetchJobs.insert( job );
+    }
+
+    if ( fetchJobs.isEmpty() ) // Nothing to fetch
+        emit fetchFinished( true );
+}
+
+void AkonadiIncidenceStore::abortFetch() {
+    foreach ( KJob * job, fetchJobs )
+        job->kill(); // Quietly, so no result will be delivered
+
+    fetchJobs.clear();
+    knownRevisions.clear();
+    changedItems.clear();
+}
+
+void AkonadiIncidenceStore::fetchItem( Item::Id id ) {
+    ItemFetchJob * job = new ItemFetchJob( Item( id ), this );
+    job->fetchScope().fetchFullPayload( true );
+    job->setProperty( "itemId", id );
+
+    connect( job, SIGNAL( result(KJob *) ), this, SLOT( itemFetchResult(KJob *) ) );
+}
+
+void AkonadiIncidenceStore::fetchedItemsReceived( const Item::List & items ) {
+    if ( !listing ) {
+        emit itemsReceived( items );
+        return;
+    }
+
+    Item::List unchangedItems;
+
+    foreach ( const Item & item, items ) {
+        if ( knownRevisions.value( item.id(), -1 ) == item.revision() )
+            unchangedItems.append( item );
+        else
+            changedItems.append( item );
+    }
+
+    if ( !unchangedItems.isEmpty() )
+        emit itemsReceived( unchangedItems );
+}
+
+void AkonadiIncidenceStore::fetchResult( KJob * job ) {
+    fetchJobs.remove( job );
+
+    if ( job->error() ) {
+        kWarning() << "Failed to fetch calendar items:" << job->errorString();
+        fetchFailed = true;
+    }
+
+    if ( !fetchJobs.isEmpty() )
+        return;
+
+    if ( listing && !fetchFailed && !changedItems.isEmpty() ) { // Fetch payloads of changed items in one job
+        ItemFetchJob * fetchJob = new ItemFetchJob( changedItems, this );
+        fetchJob->fetchScope().fetchFullPayload( true );
+
+        connect( fetchJob, SIGNAL( itemsReceived(Akonadi::Item::List) ), this, SLOT( fetchedItemsReceived(Akonadi::Item::List) ) );
+        connect( fetchJob, SIGNAL( result(KJob *) ), this, SLOT( fetchResult(KJob *) ) );
+
+        fetchJobs.insert( fetchJob );
+        changedItems.clear();
+        listing = false;
+
+        return;
+    }
+
+    listing = false;
+    knownRevisions.clear();
+    changedItems.clear();
+
+    emit fetchFinished( !fetchFailed );
+}
+
+void AkonadiIncidenceStore::itemFetchResult( KJob * job ) {
+    ItemFetchJob * fetchJob = static_cast<ItemFetchJob *>( job );
+
+    if ( job->error() || fetchJob->items().isEmpty() ) {
+        kWarning() << "Failed to fetch calendar item:" << job->errorString();
+        emit itemFetched( Item( job->property( "itemId" ).toLongLong() ), false );
+        return;
+    }
+
+    emit itemFetched( fetchJob->items().first(), true );
+}
+
+int AkonadiIncidenceStore::create( const KCal::Incidence::Ptr & incidence ) {
+    Item item;
+    Collection collection;
+
+    if ( KCal::Event::Ptr event = boost::dynamic_pointer_cast<KCal::Event>( incidence ) ) {
+        item.setMimeType( eventMimeType );
+        item.setPayload<KCal::Event::Ptr>( event );
+        collection = eventCollection;
+    } else if ( KCal::Todo::Ptr todo = boost::dynamic_pointer_cast<KCal::Todo>( incidence ) ) {
+        item.setMimeType( todoMimeType );
+        item.setPayload<KCal::Todo::Ptr>( todo );
+        collection = todoCollection;
+    }
+
+    if ( !collection.isValid() )
+        return 0;
+
+    const int writeId = nextWriteId();
+
+    emit writeSubmitted( writeId, item );
+
+    writeQueue->create( writeId, item, collection );
+
+    return writeId;
+}
+
+int AkonadiIncidenceStore::modify( const Item & item ) {
+    const int writeId = nextWriteId();
+
+    emit writeSubmitted( writeId, item );
+
+    writeQueue->modify( writeId, item );
+
+    return writeId;
+}
+
+void AkonadiIncidenceStore::monitorItemAdded( const Item & item, const Collection & collection ) {
+    if ( isSearched( collection ) )
+        emit itemStored( item );
+}
+
+void AkonadiIncidenceStore::monitorItemChanged( const Item & item, const QSet<QByteArray> & partIdentifiers ) {
+    Q_UNUSED( partIdentifiers )
+
+    emit itemStored( item );
+}
+
+void AkonadiIncidenceStore::monitorItemMoved( const Item & item, const Collection & source, const Collection & destination ) {
+    Q_UNUSED( source )
+
+    if ( isSearched( destination ) )
+        emit itemStored( item );
+    else
+        emit itemRemoved( item );
+}
+
+void AkonadiIncidenceStore::monitorItemRemoved( const Item & item ) {
+    emit itemRemoved( item );
+}
+
+bool AkonadiIncidenceStore::isSearched( const Collection & collection ) const {
+    foreach ( const Collection & searched, collections )
+        if ( searched.id() == collection.id() )
+            return true;
+
+    return false;
+}
@@ -0,0 +1,111 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AKONADI_INCIDENCE_STORE_H
+#define AKONADI_INCIDENCE_STORE_H
+
+//Project-Includes
+#include "incidence_store.h"
+
+//KDE-Includes
+#include <Akonadi/Collection>
+
+//Qt
+#include <QSet>
+
+class AkonadiWriteQueue;
+class CollectionSelector;
+class KJob;
+
+namespace Akonadi {
+    class Monitor;
+}
+
+/**
+  Store of incidences in Akonadi collections. Searched collections and
+  collections for new incidences are selected by runner configuration.
+*/
+class AkonadiIncidenceStore : public IncidenceStore
+{
+    Q_OBJECT
+
+public:
+    explicit AkonadiIncidenceStore( QObject * parent );
+
+    void configure( const KConfigGroup & config );
+
+    bool isReady() const { return configured; }
+
+    QString source() const { return configuredSource; }
+
+    void fetch( const QHash<Akonadi::Item::Id, int> & knownRevisions );
+    void abortFetch();
+
+    void fetchItem( Akonadi::Item::Id id );
+
+    int create( const KCal::Incidence::Ptr & incidence );
+    int modify( const Akonadi::Item & item );
+
+private slots:
+
+    /**
+      Called when Akonadi collections loaded
+    */
+    void collectionsReceived( CollectionSelector & selector );
+
+    void fetchedItemsReceived( const Akonadi::Item::List & items );
+    void fetchResult( KJob * job );
+    void itemFetchResult( KJob * job );
+
+    void monitorItemAdded( const Akonadi::Item & item, const Akonadi::Collection & collection );
+    void monitorItemChanged( const Akonadi::Item & item, const QSet<QByteArray> & partIdentifiers );
+    void monitorItemMoved( const Akonadi::Item & item, const Akonadi::Collection & source, const Akonadi::Collection & destination );
+    void monitorItemRemoved( const Akonadi::Item & item );
+
+private:
+
+    bool isSearched( const Akonadi::Collection & collection ) const;
+
+    void setCollections( const Akonadi::Collection::List & collections );
+
+private:
+
+    Akonadi::Monitor * monitor;
+    AkonadiWriteQueue * writeQueue;
+    Akonadi::Collection::List collections; // Searched collections
+    bool configured;
+
+    Akonadi::Collection eventCollection, todoCollection; // Collections for new incidences
+
+    // Configuration applied when collections are received
+    Akonadi::Collection::Id eventCollectionId, todoCollectionId;
+    QList<Akonadi::Collection::Id> searchCollectionIds;
+    bool searchAllCollections; // Including ones created later, ids are ignored then
+    QString configuredSource; // Searched collections by configuration, empty until configured
+
+    QSet<KJob *> fetchJobs; // Running fetch jobs
+    bool fetchFailed;
+
+    QHash<Akonadi::Item::Id, int> knownRevisions; // Revisions of items, which payload isn't needed
+    Akonadi::Item::List changedItems; // Listed items, which payload should be fetched
+    bool listing; // Whether collections are listed without payloads
+};
+
+#endif
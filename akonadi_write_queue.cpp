@@ -0,0 +1,163 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Project-Includes
+#include "akonadi_write_queue.h"
+
+//KDE-Includes
+#include <KDebug>
+#include <Akonadi/ItemCreateJob>
+#include <Akonadi/ItemModifyJob>
+#include <Akonadi/TransactionSequence>
+
+//Qt-Includes
+#include <QTimer>
+
+using namespace Akonadi;
+
+static const int flushDelay = 100; // Milliseconds to wait for more writes before starting transaction
+static const int retryDelay = 2000; // Milliseconds before retrying after lost connection
+static const int maxAttempts = 3;
+
+AkonadiWriteQueue::AkonadiWriteQueue( QObject * parent ) : QObject( parent ) {
+    flushTimer = new QTimer( this );
+    flushTimer->setSingleShot( true );
+    flushTimer->setInterval( flushDelay );
+
+    retryTimer = new QTimer( this );
+    retryTimer->setSingleShot( true );
+    retryTimer->setInterval( retryDelay );
+
+    connect( flushTimer, SIGNAL( timeout() ), this, SLOT( flush() ) );
+    connect( retryTimer, SIGNAL( timeout() ), this, SLOT( retry() ) );
+}
+
+void AkonadiWriteQueue::create( int writeId, const Item & item, const Collection & collection ) {
+    Write write = { writeId, item, collection, 0 };
+
+    enqueue( write );
+}
+
+void AkonadiWriteQueue::modify( int writeId, const Item & item ) {
+    Write write = { writeId, item, Collection(), 0 };
+
+    enqueue( write );
+}
+
+void AkonadiWriteQueue::enqueue( const Write & write ) {
+    queuedWrites.append( write );
+
+    if ( !flushTimer->isActive() ) // Window starts with the first write
+        flushTimer->start();
+}
+
+void AkonadiWriteQueue::flush() {
+    if ( queuedWrites.isEmpty() )
+        return;
+
+    startTransaction( queuedWrites );
+    queuedWrites.clear();
+}
+
+void AkonadiWriteQueue::retry() {
+    queuedWrites += failedWrites;
+    failedWrites.clear();
+
+    flush();
+}
+
+void AkonadiWriteQueue::startTransaction( const QList<Write> & writes ) {
+    TransactionSequence * transaction = new TransactionSequence( this );
+
+    foreach ( const Write & write, writes ) {
+        KJob * job;
+
+        if ( write.collection.isValid() ) {
+            job = new ItemCreateJob( write.item, write.collection, transaction );
+        } else {
+            ItemModifyJob * modifyJob = new ItemModifyJob( write.item, transaction );
+            modifyJob->setIgnorePayload( false ); // Update payload!!
+
+            job = modifyJob;
+        }
+
+        job->setProperty( "writeId", write.id );
+
+        connect( job, SIGNAL( result(KJob *) ), this, SLOT( writeResult(KJob *) ) );
+    }
+
+    connect( transaction, SIGNAL( result(KJob *) ), this, SLOT( transactionResult(KJob *) ) );
+
+    transactions.insert( transaction, writes );
+}
+
+void AkonadiWriteQueue::writeResult( KJob * job ) {
+    if ( job->error() )
+        return; // Reported with the whole transaction
+
+    const int writeId = job->property( "writeId" ).toInt();
+
+    if ( ItemCreateJob * createJob = qobject_cast<ItemCreateJob *>( job ) )
+        writtenItems.insert( writeId, createJob->item() );
+    else if ( ItemModifyJob * modifyJob = qobject_cast<ItemModifyJob *>( job ) )
+        writtenItems.insert( writeId, modifyJob->item() );
+}
+
+void AkonadiWriteQueue::transactionResult( KJob * job ) {
+    const QList<Write> writes = transactions.take( job );
+
+    if ( !job->error() ) {
+        foreach ( const Write & write, writes )
+            emit finished( write.id, writtenItems.take( write.id ), true );
+
+        return;
+    }
+
+    foreach ( const Write & write, writes ) // Transaction was rolled back, so nothing is stored
+        writtenItems.remove( write.id );
+
+    if ( writes.size() > 1 ) { // Find failing writes by repeating them separately
+        foreach ( const Write & write, writes )
+            startTransaction( QList<Write>() << write );
+
+        return;
+    }
+
+    Write write = writes.first();
+
+    if ( isTransient( job ) && ++ write.attempts < maxAttempts ) {
+        kDebug() << "Retrying write" << write.id << "after error:" << job->errorString();
+
+        failedWrites.append( write );
+
+        if ( !retryTimer->isActive() )
+            retryTimer->start();
+
+        return;
+    }
+
+    kWarning() << "Failed to store calendar item:" << job->errorString();
+
+    emit finished( write.id, write.item, false );
+}
+
+bool AkonadiWriteQueue::isTransient( KJob * job ) {
+    return job->error() == Job::ConnectionFailed;
+}
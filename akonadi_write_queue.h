@@ -0,0 +1,111 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AKONADI_WRITE_QUEUE_H
+#define AKONADI_WRITE_QUEUE_H
+
+//KDE-Includes
+#include <Akonadi/Collection>
+#include <Akonadi/Item>
+
+//Qt
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+class KJob;
+class QTimer;
+
+/**
+  Queue of item writes, which coalesces writes issued within a short window
+  into one Akonadi transaction, so burst of actions costs one round trip.
+
+  Each write is reported separately. If transaction fails, its writes are
+  repeated one by one, so only failing ones are reported as failed. Writes
+  failed due to lost connection are retried a few times.
+*/
+class AkonadiWriteQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AkonadiWriteQueue( QObject * parent );
+
+    /**
+      Queue creation of item in given collection
+    */
+    void create( int writeId, const Akonadi::Item & item, const Akonadi::Collection & collection );
+
+    /**
+      Queue modification of item payload
+    */
+    void modify( int writeId, const Akonadi::Item & item );
+
+signals:
+
+    /**
+      Write finished, with stored item in case of success
+    */
+    void finished( int writeId, const Akonadi::Item & item, bool success );
+
+private slots:
+
+    /**
+      Start transaction with all queued writes
+    */
+    void flush();
+
+    /**
+      Queue writes waiting for retry
+    */
+    void retry();
+
+    void writeResult( KJob * job );
+    void transactionResult( KJob * job );
+
+private:
+
+    struct Write {
+        int id;
+        Akonadi::Item item;
+        Akonadi::Collection collection; // Valid only for creation
+        int attempts;
+    };
+
+private:
+
+    void enqueue( const Write & write );
+
+    void startTransaction( const QList<Write> & writes );
+
+    static bool isTransient( KJob * job );
+
+private:
+
+    QList<Write> queuedWrites;
+    QList<Write> failedWrites; // Waiting for retry
+    QTimer * flushTimer;
+    QTimer * retryTimer;
+
+    QHash<KJob *, QList<Write> > transactions; // Writes of running transactions
+    QHash<int, Akonadi::Item> writtenItems; // Items stored by finished write jobs of running transactions
+};
+
+#endif
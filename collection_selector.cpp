@@ -51,6 +51,26 @@ void CollectionSelector::akonadiCollectionsReceived( const Collection::List& col
     emit collectionsReceived( *this );
 }
 
+Collection::List CollectionSelector::calendarCollections() const {
+    Collection::List collections = eventCollections;
+
+    foreach ( const Collection & collection, todoCollections )
+        if ( !collections.contains( collection ) )
+            collections.append( collection );
+
+    return collections;
+}
+
+Collection::List CollectionSelector::selectCalendarCollections( const QList<Akonadi::Entity::Id> & ids ) const {
+    Collection::List collections;
+
+    foreach ( const Collection & collection, calendarCollections() )
+        if ( ids.contains( collection.id() ) )
+            collections.append( collection );
+
+    return collections;
+}
+
 Collection CollectionSelector::selectCollectionById( const Collection::List& collections, Akonadi::Entity::Id id ) {
     foreach ( const Collection & collection, collections )
         if ( collection.id() == id )
@@ -44,6 +44,16 @@ public:
     Akonadi::Collection selectTodoCollection( Akonadi::Entity::Id id ) { return selectCollectionById( todoCollections, id ); }
     Akonadi::Collection selectEventCollection( Akonadi::Entity::Id id ) { return selectCollectionById( eventCollections, id ); }
 
+    /**
+      All collections containing events or todos, without duplicates
+    */
+    Akonadi::Collection::List calendarCollections() const;
+
+    /**
+      Calendar collections with given ids
+    */
+    Akonadi::Collection::List selectCalendarCollections( const QList<Akonadi::Entity::Id> & ids ) const;
+
 signals:
     void collectionsReceived( CollectionSelector & selector );
 
@@ -0,0 +1,361 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "datetime_format.h"
+
+#include <QDebug>
+#include <QLocale>
+#include <QStringList>
+
+static const int numberKey = DateTimeToken::typeKey( DateTimeToken::Number );
+static const int wordKey = DateTimeToken::typeKey( DateTimeToken::Word );
+
+/**
+  Localized long and short names of months or week days
+*/
+struct NameTable {
+    explicit NameTable( bool months ) {
+        for ( int i = 1; i <= ( months ? 12 : 7 ); ++ i ) {
+            longNames.append( months ? QDate::longMonthName( i ) : QDate::longDayName( i ) );
+            shortNames.append( months ? QDate::shortMonthName( i ) : QDate::shortDayName( i ) );
+        }
+    }
+
+    /**
+      Number of name, starting from 1, or 0 if it isn't known
+    */
+    int find( const QStringRef & word ) const {
+        for ( int i = 0; i < longNames.size(); ++ i )
+            if ( word.compare( longNames[i], Qt::CaseInsensitive ) == 0 || word.compare( shortNames[i], Qt::CaseInsensitive ) == 0 )
+                return i + 1;
+
+        return 0;
+    }
+
+    QStringList longNames, shortNames;
+};
+
+static const NameTable & monthNames() {
+    static const NameTable names( true );
+
+    return names;
+}
+
+static const NameTable & dayNames() {
+    static const NameTable names( false );
+
+    return names;
+}
+
+DateTimeFormat::DateTimeFormat( const QString & format, Type type ) : formatString( format ), formatType( type ), valid( true ), twelveHour( false ), year( false ) {
+    bool quoted = false;
+    bool spaced = false;
+    int i = 0;
+
+    while ( i < format.length() ) {
+        const QChar c = format[i];
+        Field field;
+        field.minWidth = field.maxWidth = 0;
+
+        if ( c == '\'' ) {
+            quoted = !quoted;
+            ++ i;
+            continue;
+        } else if ( c.isSpace() ) {
+            spaced = true;
+            ++ i;
+            continue;
+        }
+
+        const int length = quoted ? 0 : parseCode( format, i, field );
+
+        if ( length > 0 ) {
+            appendField( field.minWidth > 0 ? numberKey : wordKey, field, spaced );
+            i += length;
+        } else if ( c.isLetter() ) {
+            field.type = Literal;
+            field.text = c;
+            appendField( wordKey, field, spaced );
+            ++ i;
+        } else if ( c.isDigit() ) {
+            qDebug() << "Digits aren't supported in date/time formats:" << format;
+            valid = false;
+            ++ i;
+        } else {
+            Element element;
+            element.key = c.unicode();
+            elements.append( element );
+            ++ i;
+        }
+
+        spaced = false;
+    }
+
+    if ( elements.isEmpty() )
+        valid = false;
+}
+
+int DateTimeFormat::parseCode( const QString & format, int pos, Field & field ) {
+    const QChar c = format[pos];
+    int run = 1;
+
+    while ( pos + run < format.length() && format[pos + run] == c )
+        ++ run;
+
+    switch ( c.toLatin1() ) {
+        case 'd':
+        case 'M':
+            if ( run >= 3 ) {
+                field.type = c == 'd' ? DayName : MonthName;
+                return qMin( run, 4 );
+            }
+
+            field.type = c == 'd' ? Day : Month;
+            field.minWidth = run;
+            field.maxWidth = 2;
+            return run;
+        case 'y':
+            if ( run < 2 ) // Single 'y' isn't a code
+                return 0;
+
+            field.type = run >= 4 ? Year : ShortYear;
+            field.minWidth = field.maxWidth = run >= 4 ? 4 : 2;
+            return field.maxWidth;
+        case 'h':
+        case 'H':
+        case 'm':
+        case 's':
+            field.type = c == 'm' ? Minute : c == 's' ? Second : Hour;
+            field.minWidth = qMin( run, 2 );
+            field.maxWidth = 2;
+            return field.minWidth;
+        case 'z':
+            field.type = Msec;
+            field.minWidth = run >= 3 ? 3 : 1;
+            field.maxWidth = 3;
+            return field.minWidth;
+        case 'A':
+        case 'a':
+            field.type = AmPm;
+            return pos + 1 < format.length() && format[pos + 1].toLower() == 'p' ? 2 : 1;
+        default:
+            return 0;
+    }
+}
+
+void DateTimeFormat::appendField( int key, const Field & field, bool spaced ) {
+    if ( field.type == Year || field.type == ShortYear )
+        year = true;
+    else if ( field.type == AmPm )
+        twelveHour = true;
+
+    if ( !spaced && !elements.isEmpty() && elements.last().key == key ) { // Fields of same kind form single token
+        Element & last = elements.last();
+
+        if ( key == numberKey ) {
+            last.fields.append( field );
+        } else if ( last.fields.last().type == Literal && field.type == Literal ) {
+            last.fields.last().text += field.text;
+        } else {
+            qDebug() << "Adjacent names aren't supported in date/time formats:" << formatString;
+            valid = false;
+        }
+
+        return;
+    }
+
+    Element element;
+    element.key = key;
+    element.fields.append( field );
+
+    elements.append( element );
+}
+
+QVector<int> DateTimeFormat::keys() const {
+    QVector<int> result;
+
+    foreach ( const Element & element, elements )
+        result.append( element.key );
+
+    return result;
+}
+
+bool DateTimeFormat::matchDate( const QStringRef & s, const DateTimeToken * tokens, int count, QDate & date ) const {
+    Values values;
+
+    if ( !extract( s, tokens, count, values ) )
+        return false;
+
+    if ( values.year < 0 )
+        values.year = QDate::currentDate().year();
+
+    if ( !QDate::isValid( values.year, values.month, values.day ) )
+        return false;
+
+    date = QDate( values.year, values.month, values.day );
+
+    return true;
+}
+
+bool DateTimeFormat::matchTime( const QStringRef & s, const DateTimeToken * tokens, int count, QTime & time ) const {
+    Values values;
+
+    if ( !extract( s, tokens, count, values ) )
+        return false;
+
+    if ( twelveHour ) {
+        if ( values.hour < 1 || values.hour > 12 )
+            return false;
+
+        values.hour = values.hour % 12 + ( values.pm > 0 ? 12 : 0 );
+    }
+
+    if ( !QTime::isValid( values.hour, values.minute, values.second, values.msec ) )
+        return false;
+
+    time = QTime( values.hour, values.minute, values.second, values.msec );
+
+    return true;
+}
+
+bool DateTimeFormat::extract( const QStringRef & s, const DateTimeToken * tokens, int count, Values & values ) const {
+    if ( !valid || count != elements.size() )
+        return false;
+
+    values.year = -1;
+    values.month = values.day = 1;
+    values.hour = values.minute = values.second = values.msec = 0;
+    values.pm = -1;
+
+    for ( int i = 0; i < count; ++ i ) {
+        const Element & element = elements[i];
+        const DateTimeToken & token = tokens[i];
+
+        if ( token.key() != element.key )
+            return false;
+
+        if ( element.key == numberKey ) {
+            if ( !extractNumbers( s.unicode() + token.position, token.length, element.fields, values ) )
+                return false;
+        } else if ( element.key == wordKey ) {
+            if ( !extractWord( DateTimeLexer::text( s, token ), element.fields.first(), values ) )
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool DateTimeFormat::extractNumbers( const QChar * digits, int length, const QVector<Field> & fields, Values & values ) {
+    int minRemaining = 0; // Minimal number of digits needed by fields not yet extracted
+
+    foreach ( const Field & field, fields )
+        minRemaining += field.minWidth;
+
+    int pos = 0;
+
+    foreach ( const Field & field, fields ) {
+        minRemaining -= field.minWidth;
+
+        const int width = qMin( field.maxWidth, length - pos - minRemaining );
+
+        if ( width < field.minWidth )
+            return false;
+
+        int value = 0;
+
+        for ( int i = 0; i < width; ++ i )
+            value = value * 10 + digits[pos + i].digitValue();
+
+        pos += width;
+
+        switch ( field.type ) {
+            case Day: values.day = value; break;
+            case Month: values.month = value; break;
+            case ShortYear: values.year = 2000 + value; break;
+            case Year: values.year = value; break;
+            case Hour: values.hour = value; break;
+            case Minute: values.minute = value; break;
+            case Second: values.second = value; break;
+            case Msec: values.msec = value; break;
+            default: return false;
+        }
+    }
+
+    return pos == length;
+}
+
+bool DateTimeFormat::extractWord( const QStringRef & word, const Field & field, Values & values ) {
+    switch ( field.type ) {
+        case MonthName:
+            values.month = monthNames().find( word );
+            return values.month > 0;
+        case DayName:
+            return dayNames().find( word ) > 0; // Day of week only has to be valid
+        case AmPm:
+            if ( word.compare( QLatin1String( "am" ), Qt::CaseInsensitive ) == 0 || word.compare( QLocale::system().amText(), Qt::CaseInsensitive ) == 0 )
+                values.pm = 0;
+            else if ( word.compare( QLatin1String( "pm" ), Qt::CaseInsensitive ) == 0 || word.compare( QLocale::system().pmText(), Qt::CaseInsensitive ) == 0 )
+                values.pm = 1;
+
+            return values.pm >= 0;
+        case Literal:
+            return word.compare( field.text, Qt::CaseInsensitive ) == 0;
+        default:
+            return false;
+    }
+}
+
+QString DateTimeFormat::fromLocaleFormat( const QString & format ) {
+    QString result;
+
+    for ( int i = 0; i < format.length(); ++ i ) {
+        const QChar c = format[i];
+
+        if ( c != '%' || i + 1 == format.length() ) {
+            if ( c.isLetter() )
+                result += '\'' + QString( c ) + '\''; // Literal text
+            else if ( c != '\'' )
+                result += c;
+
+            continue;
+        }
+
+        switch ( format[ ++ i ].toLatin1() ) {
+            case 'Y': result += "yyyy"; break;
+            case 'y': result += "yy"; break;
+            case 'm': case 'n': result += "M"; break;
+            case 'd': case 'e': result += "d"; break;
+            case 'B': result += "MMMM"; break;
+            case 'b': result += "MMM"; break;
+            case 'A': result += "dddd"; break;
+            case 'a': result += "ddd"; break;
+            case 'H': case 'k': result += "H"; break;
+            case 'I': case 'l': result += "h"; break;
+            case 'M': result += "m"; break;
+            case 'S': result += "s"; break;
+            case 'p': result += "AP"; break;
+            case '%': result += '%'; break;
+            default: break; // Unsupported codes are skipped
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,136 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATETIME_FORMAT_H
+#define DATETIME_FORMAT_H
+
+#include "datetime_lexer.h"
+
+#include <QDate>
+#include <QTime>
+#include <QVector>
+
+/**
+  Date or time format, compiled from Qt format string. Compiled format matches
+  tokens of expression directly: fields are validated and extracted in single
+  pass, without regular expressions and without parsing text again.
+*/
+class DateTimeFormat {
+public:
+    enum Type {
+        Date,
+        Time
+    };
+
+public:
+    DateTimeFormat() : formatType( Date ), valid( false ), twelveHour( false ), year( false ) {}
+    DateTimeFormat( const QString & format, Type type );
+
+    /**
+      Check if format was compiled, formats with unsupported elements aren't
+    */
+    bool isValid() const { return valid; }
+
+    Type type() const { return formatType; }
+    const QString & format() const { return formatString; }
+
+    /**
+      Check if format contains year, otherwise current year is assumed
+    */
+    bool hasYear() const { return year; }
+
+    /**
+      Keys of tokens, which text in this format consists of
+    */
+    QVector<int> keys() const;
+
+    /**
+      Extract date or time from given tokens of expression, returns false if
+      they don't form valid date or time in this format
+    */
+    bool matchDate( const QStringRef & s, const DateTimeToken * tokens, int count, QDate & date ) const;
+    bool matchTime( const QStringRef & s, const DateTimeToken * tokens, int count, QTime & time ) const;
+
+    /**
+      Convert KLocale date or time format to Qt format. Numeric fields accept
+      one or two digits, as dates are typed by people
+    */
+    static QString fromLocaleFormat( const QString & format );
+
+private:
+
+    enum FieldType {
+        Day,
+        Month,
+        ShortYear,
+        Year,
+        Hour,
+        Minute,
+        Second,
+        Msec,
+        AmPm,
+        MonthName,
+        DayName,
+        Literal
+    };
+
+    struct Field {
+        FieldType type;
+        int minWidth, maxWidth; // Digits of numeric field
+        QString text; // Text of literal
+    };
+
+    /**
+      Fields forming single token
+    */
+    struct Element {
+        int key;
+        QVector<Field> fields;
+    };
+
+    struct Values {
+        int year, month, day;
+        int hour, minute, second, msec;
+        int pm; // -1 if not specified
+    };
+
+private:
+
+    /**
+      Parse format code at given position, returns its length or 0 if there is no code
+    */
+    static int parseCode( const QString & format, int pos, Field & field );
+
+    void appendField( int key, const Field & field, bool spaced );
+
+    bool extract( const QStringRef & s, const DateTimeToken * tokens, int count, Values & values ) const;
+    static bool extractNumbers( const QChar * digits, int length, const QVector<Field> & fields, Values & values );
+    static bool extractWord( const QStringRef & word, const Field & field, Values & values );
+
+private:
+    QString formatString;
+    Type formatType;
+    QVector<Element> elements;
+    bool valid;
+    bool twelveHour; // Format contains AM/PM marker
+    bool year;
+};
+
+#endif
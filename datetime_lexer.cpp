@@ -0,0 +1,84 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "datetime_lexer.h"
+
+static const int maxNumberValue = 99999999; // Larger numbers are clamped, no expression needs them
+
+static uint hashChars( const QChar * chars, int length ) {
+    uint h = 2166136261u; // FNV-1a
+
+    for ( int i = 0; i < length; ++ i ) {
+        h ^= chars[i].unicode();
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+void DateTimeLexer::tokenize( const QStringRef & s, DateTimeTokenList & tokens ) {
+    const QChar * chars = s.unicode();
+    const int length = s.length();
+
+    tokens.clear();
+
+    int i = 0;
+
+    while ( i < length ) {
+        const QChar c = chars[i];
+
+        if ( c.isSpace() ) {
+            ++ i;
+            continue;
+        }
+
+        DateTimeToken token;
+        token.position = i;
+
+        if ( c.isDigit() ) {
+            token.type = DateTimeToken::Number;
+            token.value = 0;
+
+            for ( ; i < length && chars[i].isDigit(); ++ i )
+                token.value = qMin( token.value * 10 + chars[i].digitValue(), maxNumberValue );
+        } else if ( c.isLetter() ) {
+            token.type = DateTimeToken::Word;
+            token.value = 0;
+
+            for ( ; i < length && chars[i].isLetter(); ++ i ) {}
+        } else {
+            token.type = DateTimeToken::Symbol;
+            token.value = c.unicode();
+
+            ++ i;
+        }
+
+        token.length = i - token.position;
+        tokens.append( token );
+    }
+}
+
+uint DateTimeLexer::hash( const QStringRef & s, const DateTimeToken & token ) {
+    return hashChars( s.unicode() + token.position, token.length );
+}
+
+uint DateTimeLexer::hash( const QString & word ) {
+    return hashChars( word.constData(), word.length() );
+}
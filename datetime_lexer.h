@@ -0,0 +1,85 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATETIME_LEXER_H
+#define DATETIME_LEXER_H
+
+#include <QString>
+#include <QVarLengthArray>
+
+/**
+  Token of date/time expression, refers to expression text by position
+  relative to start of the expression
+*/
+class DateTimeToken {
+public:
+    enum Type {
+        Number,
+        Word,
+        Symbol
+    };
+
+public:
+
+    /**
+      Key of token kind: all numbers share one key, all words share another,
+      symbols are keyed by their character
+    */
+    int key() const { return type == Symbol ? value : typeKey( type ); }
+
+    /**
+      Key of numbers or words
+    */
+    static int typeKey( Type type ) { return -1 - type; }
+
+public:
+    Type type;
+    int position, length;
+    int value; // Value of number or character code of symbol
+};
+
+Q_DECLARE_TYPEINFO( DateTimeToken, Q_PRIMITIVE_TYPE );
+
+typedef QVarLengthArray<DateTimeToken, 32> DateTimeTokenList;
+
+/**
+  Single pass tokenizer of date/time expressions. Splits text into numbers,
+  words and single character symbols, skipping whitespace.
+*/
+class DateTimeLexer {
+public:
+
+    static void tokenize( const QStringRef & s, DateTimeTokenList & tokens );
+
+    /**
+      Text of token in given expression, not copied
+    */
+    static QStringRef text( const QStringRef & s, const DateTimeToken & token ) {
+        return QStringRef( s.string(), s.position() + token.position, token.length );
+    }
+
+    /**
+      Hash of token text, allows looking words up without copying them
+    */
+    static uint hash( const QStringRef & s, const DateTimeToken & token );
+    static uint hash( const QString & word );
+};
+
+#endif
@@ -20,16 +20,14 @@
 
 #include "datetime_parser.h"
 
+#include <KGlobal>
+#include <KLocale>
 #include <KLocalizedString>
 #include <QDebug>
+#include <QMultiHash>
 
-// Phrase regular expressions
-static const QRegExp inMinutes( i18nc( "In number of minutes phrase (may contain regexp symbols)", "in %1 minutes (after)?", "([+-]?\\d+)" ).replace(" ","\\s*") );
-static const QRegExp inHours( i18nc( "In number of hours phrase (may contain regexp symbols)", "in %1 hours (after)?", "([+-]?\\d+)" ).replace(" ","\\s*") );
-static const QRegExp inDays( i18nc( "In number of days phrase (may contain regexp symbols)", "in %1 days (after)?", "([+-]?\\d+)" ).replace(" ","\\s*") );
-static const QRegExp inWeeks( i18nc( "In number of weeks phrase (may contain regexp symbols)", "in %1 weeks (after)?", "([+-]?\\d+)" ).replace(" ","\\s*") );
-static const QRegExp inMonths( i18nc( "In number of months phrase (may contain regexp symbols)", "in %1 months (after)?", "([+-]?\\d+)" ).replace(" ","\\s*") );
-static const QRegExp inYears( i18nc( "In number of years phrase (may contain regexp symbols)", "in %1 years (after)?", "([+-]?\\d+)" ).replace(" ","\\s*") );
+static const int numberKey = DateTimeToken::typeKey( DateTimeToken::Number );
+static const int wordKey = DateTimeToken::typeKey( DateTimeToken::Word );
 
 // Keywords
 static const QString now = i18nc( "Current time keyword", "now" );
@@ -37,168 +35,438 @@ static const QString today = i18nc( "Current day keyword", "today" );
 static const QString tomorrow = i18nc( "Next day keyword", "tomorrow" );
 static const QString yesterday = i18nc( "Previous day keyword", "yesterday" );
 
-static const QString from = i18nc( "Keyword for start datetime", "from" ) + " ";
-static const QString to = i18nc( "Keyword for finish datetime", "to" ) + " ";
+static const QString from = i18nc( "Keyword for start datetime", "from" );
+static const QString to = i18nc( "Keyword for finish datetime", "to" );
+
+static const QString after = i18nc( "Optional keyword after relative phrase, as in 'in 2 days after tomorrow'", "after" );
+
+enum Keyword {
+    NoKeyword,
+    Now,
+    Today,
+    Tomorrow,
+    Yesterday,
+    From,
+    To,
+    After
+};
+
+// Units of relative phrases
+enum Unit {
+    Minutes,
+    Hours,
+    Days,
+    Weeks,
+    Months,
+    Years
+};
+
+/**
+  Relative phrase, like "in 2 days", compiled to token keys
+*/
+struct RelativePhrase {
+    QVector<int> keys; // Position of number is marked by number key
+    QStringList words; // Texts of word tokens in order of appearance
+    Unit unit;
+};
+
+/**
+  Grammar of date/time keywords and relative phrases. Both are indexed by text
+  of their first word, so lookup cost doesn't depend on their number
+*/
+class DateTimeGrammar {
+public:
+    DateTimeGrammar();
+
+    Keyword keyword( const QStringRef & s, const DateTimeToken & token ) const;
+
+    /**
+      Match relative phrase starting at given token, returns position of
+      token after it, or first if no phrase matched
+    */
+    int matchPhrase( const QStringRef & s, const DateTimeTokenList & tokens, int first, Unit & unit, int & value ) const;
+
+private:
+
+    struct KeywordEntry {
+        QString word;
+        Keyword keyword;
+    };
+
+private:
+
+    void addKeyword( const QString & word, Keyword keyword );
+    void addPhrase( const QString & phrase, Unit unit );
+
+    /**
+      Match phrase at given token, returns position of token after it or -1
+    */
+    int matchPhrase( const RelativePhrase & phrase, const QStringRef & s, const DateTimeTokenList & tokens, int first, int & value ) const;
+
+    static bool isWord( const QStringRef & s, const DateTimeToken & token, const QString & word ) {
+        return token.type == DateTimeToken::Word && token.length == word.length() && DateTimeLexer::text( s, token ) == word;
+    }
 
-DateTimeParser::DateTimeParser() {
-    addTimeFormat( "h:mm" );
-    
-    addDateFormat( "d.M.yyyy" );
+private:
+
+    QMultiHash<uint, KeywordEntry> keywords; // By hash of word
+    QVector<RelativePhrase> phrases;
+    QMultiHash<uint, int> wordPhrases; // Positions of phrases by hash of their first word
+    QList<int> otherPhrases; // Positions of phrases, which don't start with word
+};
+
+DateTimeGrammar::DateTimeGrammar() {
+    addKeyword( now, Now );
+    addKeyword( today, Today );
+    addKeyword( tomorrow, Tomorrow );
+    addKeyword( yesterday, Yesterday );
+    addKeyword( from, From );
+    addKeyword( to, To );
+    addKeyword( after, After );
+
+    addPhrase( i18nc( "In number of minutes phrase, # is replaced by number", "in # minutes" ), Minutes );
+    addPhrase( i18nc( "In number of hours phrase, # is replaced by number", "in # hours" ), Hours );
+    addPhrase( i18nc( "In number of days phrase, # is replaced by number", "in # days" ), Days );
+    addPhrase( i18nc( "In number of weeks phrase, # is replaced by number", "in # weeks" ), Weeks );
+    addPhrase( i18nc( "In number of months phrase, # is replaced by number", "in # months" ), Months );
+    addPhrase( i18nc( "In number of years phrase, # is replaced by number", "in # years" ), Years );
 }
 
-void DateTimeParser::addTimeFormat( const QString & s ) {
-    if ( timeFormats.contains( s ) )
-        return;
-    
-    QString formatRegexp = QRegExp::escape( s );
-    
-    formatRegexp.replace( QRegExp("hh|mm|ss"), "\\d\\d" );
-    formatRegexp.replace( QRegExp("h|m|s"), "\\d\\d?" );
-    formatRegexp.replace( "zzz", "\\d\\d\\d" );
-    formatRegexp.replace( "z", "\\d\\d?\\d?" );
-    formatRegexp.replace( QRegExp("AP|ap"), "\\w{2}" );
-    
-    timeFormats.insert( s, QRegExp( formatRegexp ) );
-}
+void DateTimeGrammar::addKeyword( const QString & word, Keyword keyword ) {
+    KeywordEntry entry;
+    entry.word = word;
+    entry.keyword = keyword;
 
-void DateTimeParser::addDateFormat( const QString & s ) {
-    if ( dateFormats.contains( s ) )
-        return;
-    
-    QString formatRegexp = QRegExp::escape( s );
-        
-    formatRegexp.replace( 'd', 'D' );
-    formatRegexp.replace( "yyyy", "\\d\\d\\d\\d" );
-    formatRegexp.replace( QRegExp("DDDD|MMMM"), "\\w+" );
-    formatRegexp.replace( QRegExp("DDD|MMM"), "\\w{3}" );
-    formatRegexp.replace( QRegExp("DD|MM|yy"), "\\d\\d" );
-    formatRegexp.replace( QRegExp("D|M"), "\\d\\d?" );
-    
-    dateFormats.insert( s, QRegExp( formatRegexp ) );
+    keywords.insert( DateTimeLexer::hash( word ), entry );
 }
 
-DateTimeRange DateTimeParser::parseRange( const QString & s ) {
-    DateTimeRange range;
-    QString remaining = s.trimmed();
-    DateTimeRange::Elements elems = DateTimeRange::Both;
+void DateTimeGrammar::addPhrase( const QString & text, Unit unit ) {
+    DateTimeTokenList tokens;
+    DateTimeLexer::tokenize( QStringRef( &text ), tokens );
+
+    RelativePhrase phrase;
+    phrase.unit = unit;
 
-    while ( !remaining.isEmpty() ) {
-        if ( remaining.startsWith( from ) ) {
-            elems = DateTimeRange::Start;
-            remaining = remaining.mid( from.length() ).trimmed();
-        } else if ( remaining.startsWith( to ) ) {
-            elems = DateTimeRange::Finish;
-            remaining = remaining.mid( to.length() ).trimmed();
+    for ( int i = 0; i < tokens.size(); ++ i ) {
+        const DateTimeToken & token = tokens[i];
+
+        if ( token.type == DateTimeToken::Symbol && token.value == '#' ) {
+            phrase.keys.append( numberKey );
+        } else if ( token.type == DateTimeToken::Word ) {
+            phrase.keys.append( wordKey );
+            phrase.words.append( text.mid( token.position, token.length ) );
         } else {
-            remaining = parseElement( remaining, range, elems );
+            phrase.keys.append( token.key() );
         }
     }
 
-    return range;
+    if ( !phrase.keys.contains( numberKey ) ) {
+        qDebug() << "Relative phrase without number placeholder:" << text;
+        return;
+    }
+
+    if ( phrase.keys.first() == wordKey )
+        wordPhrases.insert( DateTimeLexer::hash( phrase.words.first() ), phrases.size() );
+    else
+        otherPhrases.append( phrases.size() );
+
+    phrases.append( phrase );
 }
 
-QString DateTimeParser::parseElement( const QString & s, DateTimeRange & range, DateTimeRange::Elements elems, const QDate & defaultDate, const QTime & defaultTime ) {
-    if ( s.startsWith( now ) ) {
-        range.setDate( QDate::currentDate(), elems );
-        range.setTime( QTime::currentTime(), elems );
+Keyword DateTimeGrammar::keyword( const QStringRef & s, const DateTimeToken & token ) const {
+    if ( token.type != DateTimeToken::Word )
+        return NoKeyword;
 
-        return s.mid( now.length() ).trimmed();
-    } else if ( s.startsWith( today ) ) {
-        range.setDate( QDate::currentDate(), elems );
+    const uint hash = DateTimeLexer::hash( s, token );
 
-        return s.mid( today.length() ).trimmed();
-    } else if ( s.startsWith( tomorrow ) ) {
-        range.setDate( QDate::currentDate().addDays( 1 ), elems );
+    for ( QMultiHash<uint, KeywordEntry>::const_iterator it = keywords.constFind( hash ); it != keywords.constEnd() && it.key() == hash; ++ it )
+        if ( isWord( s, token, it.value().word ) )
+            return it.value().keyword;
 
-        return s.mid( tomorrow.length() ).trimmed();
-    } else if ( s.startsWith( yesterday ) ) {
-        range.setDate( QDate::currentDate().addDays( -1 ), elems );
+    return NoKeyword;
+}
 
-        return s.mid( yesterday.length() ).trimmed();
-    }
+int DateTimeGrammar::matchPhrase( const QStringRef & s, const DateTimeTokenList & tokens, int first, Unit & unit, int & value ) const {
+    if ( tokens[first].type == DateTimeToken::Word ) {
+        const uint hash = DateTimeLexer::hash( s, tokens[first] );
 
-    if ( inMinutes.indexIn( s ) == 0 ) {
-        int value = inMinutes.cap( 1 ).toInt();
-        QString rem = s.mid( inMinutes.matchedLength() ).trimmed();
-        QString res = parseElement( rem, range, elems, QDate(), QTime::currentTime() );
+        for ( QMultiHash<uint, int>::const_iterator it = wordPhrases.constFind( hash ); it != wordPhrases.constEnd() && it.key() == hash; ++ it ) {
+            const int next = matchPhrase( phrases[ it.value() ], s, tokens, first, value );
+
+            if ( next >= 0 ) {
+                unit = phrases[ it.value() ].unit;
+                return next;
+            }
+        }
+    }
 
-        range.addSecs( value * 60, elems );
+    foreach ( int pos, otherPhrases ) {
+        const int next = matchPhrase( phrases[ pos ], s, tokens, first, value );
 
-        return res;
+        if ( next >= 0 ) {
+            unit = phrases[ pos ].unit;
+            return next;
+        }
     }
 
-    if ( inHours.indexIn( s ) == 0 ) {
-        int value = inHours.cap( 1 ).toInt();
-        QString rem = s.mid( inHours.matchedLength() ).trimmed();
-        QString res = parseElement( rem, range, elems, QDate(), QTime::currentTime() );
+    return first;
+}
+
+int DateTimeGrammar::matchPhrase( const RelativePhrase & phrase, const QStringRef & s, const DateTimeTokenList & tokens, int first, int & value ) const {
+    int pos = first;
+    int word = 0;
+
+    foreach ( int key, phrase.keys ) {
+        if ( pos >= tokens.size() )
+            return -1;
+
+        if ( key == numberKey ) {
+            int sign = 1;
+
+            // Sign should immediately precede number
+            if ( tokens[pos].type == DateTimeToken::Symbol && ( tokens[pos].value == '+' || tokens[pos].value == '-' ) && pos + 1 < tokens.size() && tokens[pos + 1].position == tokens[pos].position + 1 ) {
+                sign = tokens[pos].value == '-' ? -1 : 1;
+                ++ pos;
+            }
 
-        range.addSecs( value * 3600, elems );
+            if ( tokens[pos].type != DateTimeToken::Number )
+                return -1;
 
-        return res;
+            value = sign * tokens[pos].value;
+        } else if ( key == wordKey ) {
+            if ( !isWord( s, tokens[pos], phrase.words[ word ++ ] ) )
+                return -1;
+        } else if ( tokens[pos].key() != key ) {
+            return -1;
+        }
+
+        ++ pos;
     }
 
-    if ( inDays.indexIn( s ) == 0 ) {
-        int value = inDays.cap( 1 ).toInt();
-        QString rem = s.mid( inDays.matchedLength() ).trimmed();
-        QString res = parseElement( rem, range, elems, QDate::currentDate() );
+    if ( pos < tokens.size() && keyword( s, tokens[pos] ) == After )
+        ++ pos;
+
+    return pos;
+}
+
+static void dependOn( DateTimeParser::Relativity & relativity, DateTimeParser::Relativity dependency ) {
+    if ( dependency > relativity )
+        relativity = dependency;
+}
+
+static const DateTimeGrammar & grammar() {
+    static const DateTimeGrammar instance;
+
+    return instance;
+}
+
+DateTimeParser::DateTimeParser() {
+    formatNodes.append( FormatNode() );
+
+    addTimeFormat( "h:mm" );
+    
+    addDateFormat( "d.M.yyyy" );
+
+    if ( KGlobal::hasLocale() )
+        addLocaleFormats( KGlobal::locale() );
+}
+
+void DateTimeParser::addTimeFormat( const QString & s ) {
+    addFormat( DateTimeFormat( s, DateTimeFormat::Time ) );
+}
 
-        range.addDays( value, elems );
+void DateTimeParser::addDateFormat( const QString & s ) {
+    addFormat( DateTimeFormat( s, DateTimeFormat::Date ) );
+}
 
-        return res;
+void DateTimeParser::addFormat( const DateTimeFormat & format ) {
+    if ( !format.isValid() ) {
+        qDebug() << "Unsupported date/time format:" << format.format();
+        return;
     }
 
-    if ( inWeeks.indexIn( s ) == 0 ) {
-        int value = inWeeks.cap( 1 ).toInt();
-        QString rem = s.mid( inWeeks.matchedLength() ).trimmed();
-        QString res = parseElement( rem, range, elems, QDate::currentDate() );
+    int node = 0;
 
-        range.addDays( value * 7, elems );
+    foreach ( int key, format.keys() ) {
+        int child = formatNodes[node].children.value( key, -1 );
 
-        return res;
+        if ( child < 0 ) {
+            child = formatNodes.size();
+            formatNodes[node].children.insert( key, child );
+            formatNodes.append( FormatNode() );
+        }
+
+        node = child;
     }
 
-    if ( inMonths.indexIn( s ) == 0 ) {
-        int value = inMonths.cap( 1 ).toInt();
-        QString rem = s.mid( inMonths.matchedLength() ).trimmed();
-        QString res = parseElement( rem, range, elems, QDate::currentDate() );
+    QList<DateTimeFormat> & formats = formatNodes[node].formats;
+    int pos = 0;
 
-        range.addMonths( value, elems );
+    for ( ; pos < formats.size(); ++ pos ) {
+        if ( formats[pos].type() == format.type() && formats[pos].format() == format.format() )
+            return; // Already known
 
-        return res;
+        if ( formats[pos].type() < format.type() ) // Time formats go first
+            break;
     }
 
-    if ( inYears.indexIn( s ) == 0 ) {
-        int value = inYears.cap( 1 ).toInt();
-        QString rem = s.mid( inYears.matchedLength() ).trimmed();
-        QString res = parseElement( rem, range, elems, QDate::currentDate() );
+    formats.insert( pos, format );
+}
+
+void DateTimeParser::addLocaleFormats( const KLocale * locale ) {
+    addDateFormat( DateTimeFormat::fromLocaleFormat( locale->dateFormatShort() ) );
+    addDateFormat( DateTimeFormat::fromLocaleFormat( locale->dateFormat() ) );
+
+    QString timeFormat = locale->timeFormat();
+    addTimeFormat( DateTimeFormat::fromLocaleFormat( timeFormat ) );
+
+    const int seconds = timeFormat.indexOf( "%S" );
 
-        range.addYears( value, elems );
+    if ( seconds > 0 ) { // Also accept time without seconds
+        const int start = timeFormat[ seconds - 1 ].isLetterOrNumber() ? seconds : seconds - 1; // With preceding separator
 
-        return res;
+        addTimeFormat( DateTimeFormat::fromLocaleFormat( timeFormat.remove( start, seconds + 2 - start ) ) );
     }
+}
+
+DateTimeRange DateTimeParser::parseRange( const QString & s ) const {
+    return parseRange( QStringRef( &s ) );
+}
 
-    for ( FormatMap::iterator it = timeFormats.begin(); it != timeFormats.end(); ++ it ) {
-        if ( it.value().indexIn( s ) == 0 ) {
-            range.setTime( QTime::fromString( s.left( it.value().matchedLength() ), it.key() ), elems );
+DateTimeRange DateTimeParser::parseRange( const QStringRef & s, Relativity * relativity ) const {
+    DateTimeTokenList tokens;
+    DateTimeLexer::tokenize( s, tokens );
 
-            return s.mid( it.value().matchedLength() ).trimmed();
+    Relativity dependency = Absolute;
+    DateTimeRange range;
+    DateTimeRange::Elements elems = DateTimeRange::Both;
+    int pos = 0;
+
+    while ( pos < tokens.size() ) {
+        switch ( grammar().keyword( s, tokens[pos] ) ) {
+            case From:
+                elems = DateTimeRange::Start;
+                ++ pos;
+                break;
+            case To:
+                elems = DateTimeRange::Finish;
+                ++ pos;
+                break;
+            default:
+                pos = parseElement( s, tokens, pos, range, elems, dependency );
         }
     }
 
-    for ( FormatMap::iterator it = dateFormats.begin(); it != dateFormats.end(); ++ it ) {
-        if ( it.value().indexIn( s ) == 0 ) {
-            range.setDate( QDate::fromString( s.left( it.value().matchedLength() ), it.key() ), elems );
+    if ( relativity )
+        *relativity = dependency;
 
-            return s.mid( it.value().matchedLength() ).trimmed();
+    return range;
+}
+
+int DateTimeParser::parseElement( const QStringRef & s, const DateTimeTokenList & tokens, int first, DateTimeRange & range, DateTimeRange::Elements elems, Relativity & relativity, const QDate & defaultDate, const QTime & defaultTime ) const {
+    if ( first < tokens.size() ) {
+        switch ( grammar().keyword( s, tokens[first] ) ) {
+            case Now:
+                dependOn( relativity, TimeRelative );
+                range.setDate( QDate::currentDate(), elems );
+                range.setTime( QTime::currentTime(), elems );
+                return first + 1;
+            case Today:
+                dependOn( relativity, DayRelative );
+                range.setDate( QDate::currentDate(), elems );
+                return first + 1;
+            case Tomorrow:
+                dependOn( relativity, DayRelative );
+                range.setDate( QDate::currentDate().addDays( 1 ), elems );
+                return first + 1;
+            case Yesterday:
+                dependOn( relativity, DayRelative );
+                range.setDate( QDate::currentDate().addDays( -1 ), elems );
+                return first + 1;
+            default:
+                break;
+        }
+
+        Unit unit;
+        int value;
+        const int next = grammar().matchPhrase( s, tokens, first, unit, value );
+
+        if ( next > first ) {
+            dependOn( relativity, unit < Days ? TimeRelative : DayRelative );
+
+            const int res = unit < Days ? parseElement( s, tokens, next, range, elems, relativity, QDate(), QTime::currentTime() ) : parseElement( s, tokens, next, range, elems, relativity, QDate::currentDate() );
+
+            switch ( unit ) {
+                case Minutes: range.addSecs( value * 60, elems ); break;
+                case Hours: range.addSecs( value * 3600, elems ); break;
+                case Days: range.addDays( value, elems ); break;
+                case Weeks: range.addDays( value * 7, elems ); break;
+                case Months: range.addMonths( value, elems ); break;
+                case Years: range.addYears( value, elems ); break;
+            }
+
+            return res;
         }
+
+        const int formatEnd = parseFormat( s, tokens, first, range, elems, relativity );
+
+        if ( formatEnd > first )
+            return formatEnd;
     }
 
     range.setDate( defaultDate, elems );
     range.setTime( defaultTime, elems );
 
-    return "";
+    // Unknown text is skipped up to next range keyword
+    int next = first;
+
+    while ( next < tokens.size() && grammar().keyword( s, tokens[next] ) != From && grammar().keyword( s, tokens[next] ) != To )
+        ++ next;
+
+    return next;
+}
+
+int DateTimeParser::parseFormat( const QStringRef & s, const DateTimeTokenList & tokens, int first, DateTimeRange & range, DateTimeRange::Elements elems, Relativity & relativity ) const {
+    QVarLengthArray<int, 16> path; // Nodes reached after each token
+    int node = 0;
+
+    for ( int pos = first; pos < tokens.size(); ++ pos ) {
+        node = formatNodes[node].children.value( tokens[pos].key(), -1 );
+
+        if ( node < 0 )
+            break;
+
+        path.append( node );
+    }
+
+    // Prefer longest match
+    for ( int n = path.size() - 1; n >= 0; -- n ) {
+        foreach ( const DateTimeFormat & format, formatNodes[ path[n] ].formats ) {
+            if ( format.type() == DateTimeFormat::Time ) {
+                QTime time;
+
+                if ( format.matchTime( s, tokens.constData() + first, n + 1, time ) ) {
+                    dependOn( relativity, DayRelative ); // Time without date refers to current day
+                    range.setTime( time, elems );
+                    return first + n + 1;
+                }
+            } else {
+                QDate date;
+
+                if ( format.matchDate( s, tokens.constData() + first, n + 1, date ) ) {
+                    if ( !format.hasYear() )
+                        dependOn( relativity, DayRelative ); // Current year is assumed
+
+                    range.setDate( date, elems );
+                    return first + n + 1;
+                }
+            }
+        }
+    }
+
+    return first;
 }
 
-KDateTime DateTimeParser::parse( const QString& s ) {
+KDateTime DateTimeParser::parse( const QString& s ) const {
     return parseRange( s ).start;
 }
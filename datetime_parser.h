@@ -18,35 +18,89 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+
 #ifndef DATETIME_PARSER_H
 #define DATETIME_PARSER_H
 
+#include "datetime_format.h"
+#include "datetime_lexer.h"
 #include "datetime_range.h"
 
-#include <QMap>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+class KLocale;
+
+/**
+  Parser of date/time expressions. Expression is tokenized once, then keywords,
+  relative phrases and formats are looked up by tokens, so parsing cost doesn't
+  depend on number of known formats.
 
+  Parsing is reentrant: formats are only read while parsing, so parse methods
+  may be called concurrently from many threads
+*/
 class DateTimeParser {
+public:
+
+    /**
+      Dependency of parsed range on current time
+    */
+    enum Relativity {
+        Absolute,
+        DayRelative, // Changes when current day rolls over
+        TimeRelative // Changes when current time changes
+    };
+
 public:
     DateTimeParser();
     
-    KDateTime parse( const QString & s );
-    DateTimeRange parseRange( const QString & s );
+    KDateTime parse( const QString & s ) const;
+    DateTimeRange parseRange( const QString & s ) const;
+
+    /**
+      Parse range from part of some string, without copying it. If relativity
+      is given, it's set to dependency of the range on current time
+    */
+    DateTimeRange parseRange( const QStringRef & s, Relativity * relativity = 0 ) const;
     
     void addTimeFormat( const QString & s );
     void addDateFormat( const QString & s );
     
 private:
     
-    typedef QMap< QString, QRegExp > FormatMap;
+    /**
+      Node of format trie. Formats are placed in trie by keys of tokens they
+      consist of, so all formats, which may match input, are found in one walk
+    */
+    struct FormatNode {
+        QHash<int, int> children; // Child node positions by token key
+        QList<DateTimeFormat> formats; // Time formats go first
+    };
     
 private:
     
-    QString parseElement( const QString & s, DateTimeRange & range, DateTimeRange::Elements elems, const QDate & defaultDate = QDate(), const QTime & defaultTime = QTime() );
+    void addFormat( const DateTimeFormat & format );
+    
+    /**
+      Add date and time formats of given locale
+    */
+    void addLocaleFormats( const KLocale * locale );
+    
+    /**
+      Parse single element starting at given token, returns position of token after it
+    */
+    int parseElement( const QStringRef & s, const DateTimeTokenList & tokens, int first, DateTimeRange & range, DateTimeRange::Elements elems, Relativity & relativity, const QDate & defaultDate = QDate(), const QTime & defaultTime = QTime() ) const;
+    
+    /**
+      Parse longest date or time in known format starting at given token,
+      returns position of token after it, or first if nothing matched
+    */
+    int parseFormat( const QStringRef & s, const DateTimeTokenList & tokens, int first, DateTimeRange & range, DateTimeRange::Elements elems, Relativity & relativity ) const;
 
 private:
 
-    FormatMap timeFormats;
-    FormatMap dateFormats;
+    QVector<FormatNode> formatNodes; // Root node is first
 };
 
 #endif
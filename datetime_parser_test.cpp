@@ -20,6 +20,33 @@
 
 #include "datetime_parser_test.h"
 
+/**
+  Thread, parsing expressions many times with parser shared with other threads
+*/
+class ParsingThread : public QThread {
+public:
+    explicit ParsingThread( const DateTimeParser & parser ) : parser( parser ), failures( 0 ) {}
+
+    void run() {
+        const KDateTime date( QDate::fromString( "21.10.2009", "d.M.yyyy" ) );
+        const KDateTime time( date.date(), QTime::fromString( "12:00", "H:m" ) );
+
+        for ( int i = 0; i < 1000; ++ i ) {
+            if ( parser.parse( "21.10.2009" ) != date )
+                ++ failures;
+
+            if ( parser.parseRange( "21.10.2009 from 12:00 to 13:00" ).start != time )
+                ++ failures;
+
+            if ( parser.parse( "in 2 days after 21.10.2009" ) != date.addDays( 2 ) )
+                ++ failures;
+        }
+    }
+
+    const DateTimeParser & parser;
+    int failures;
+};
+
 void DateTimeParserTest::testSimpleKeywords() {
     QVERIFY( KDateTime::currentLocalDateTime() == parser.parse("now") );
     QVERIFY( KDateTime( KDateTime::currentLocalDate() ) == parser.parse("today") );
@@ -58,4 +85,56 @@ void DateTimeParserTest::testNonPointRanges() {
     QVERIFY( r2.finish == KDateTime( KDateTime::currentLocalDate(), QTime::fromString("13:00","H:m") ) );
 }
 
+void DateTimeParserTest::testRelativeRanges() {
+    DateTimeRange r1 = parser.parseRange("from in 2 days to in 3 days");
+    QVERIFY( r1.start == KDateTime( KDateTime::currentLocalDate().addDays( 2 ) ) );
+    QVERIFY( r1.finish == KDateTime( KDateTime::currentLocalDate().addDays( 3 ) ) );
+
+    DateTimeRange r2 = parser.parseRange("in -1 days from 12:00 to 13:00");
+    QVERIFY( r2.start == KDateTime( KDateTime::currentLocalDate().addDays( -1 ), QTime::fromString("12:00","H:m") ) );
+    QVERIFY( r2.finish == KDateTime( KDateTime::currentLocalDate().addDays( -1 ), QTime::fromString("13:00","H:m") ) );
+}
+
+void DateTimeParserTest::testCustomFormats() {
+    DateTimeParser custom;
+    custom.addDateFormat( "yyyy-MM-dd" );
+    custom.addDateFormat( "yyyyMMdd" );
+    custom.addDateFormat( "d MMM yyyy" );
+    custom.addTimeFormat( "h:mm AP" );
+
+    QVERIFY( KDateTime( QDate( 2009, 10, 21 ) ) == custom.parse("2009-10-21") );
+    QVERIFY( KDateTime( QDate( 2009, 10, 21 ) ) == custom.parse("20091021") );
+    QVERIFY( KDateTime( QDate( 2009, 10, 21 ) ) == custom.parse("21 Oct 2009") );
+    QVERIFY( KDateTime( QDate( 2009, 10, 21 ), QTime( 13, 30 ) ) == custom.parse("21.10.2009 1:30 pm") );
+
+    QVERIFY( !custom.parse("2009-13-21").isValid() );
+}
+
+void DateTimeParserTest::testAmbiguousFormats() {
+    DateTimeParser custom;
+    custom.addDateFormat( "d.M" );
+    custom.addTimeFormat( "h.mm" ); // Same tokens as date format, added after it
+
+    QVERIFY( KDateTime( KDateTime::currentLocalDate(), QTime( 1, 10 ) ) == custom.parse("1.10") ); // Time is tried first
+    QVERIFY( KDateTime( QDate( KDateTime::currentLocalDate().year(), 10, 25 ) ) == custom.parse("25.10") ); // Not a valid time
+}
+
+void DateTimeParserTest::testConcurrentParsing() {
+    QList<ParsingThread *> threads;
+
+    for ( int i = 0; i < 4; ++ i )
+        threads.append( new ParsingThread( parser ) );
+
+    foreach ( ParsingThread * thread, threads )
+        thread->start();
+
+    foreach ( ParsingThread * thread, threads ) {
+        thread->wait();
+
+        QCOMPARE( thread->failures, 0 );
+    }
+
+    qDeleteAll( threads );
+}
+
 QTEST_MAIN(DateTimeParserTest)
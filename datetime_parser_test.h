@@ -33,6 +33,10 @@ private slots:
     void testPreciseSpecs();
     void testPointRanges();
     void testNonPointRanges();
+    void testRelativeRanges();
+    void testCustomFormats();
+    void testAmbiguousFormats();
+    void testConcurrentParsing();
 private:
     DateTimeParser parser;
 };
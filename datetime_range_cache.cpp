@@ -0,0 +1,209 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "datetime_range_cache.h"
+
+#include <QMutexLocker>
+
+/**
+  Reader of string characters as if it was simplified: without leading and
+  trailing whitespace and with inner whitespace runs replaced by single space
+*/
+class NormalizedReader {
+public:
+    explicit NormalizedReader( const QStringRef & s ) : chars( s.unicode() ), end( s.unicode() + s.length() ) {
+        while ( chars != end && chars->isSpace() )
+            ++ chars;
+
+        while ( end != chars && ( end - 1 )->isSpace() )
+            -- end;
+    }
+
+    bool atEnd() const { return chars == end; }
+
+    QChar next() {
+        if ( !chars->isSpace() )
+            return *chars ++;
+
+        while ( chars->isSpace() ) // Run is followed by non-space, as trailing whitespace is cut
+            ++ chars;
+
+        return QLatin1Char( ' ' );
+    }
+
+private:
+    const QChar * chars;
+    const QChar * end;
+};
+
+DateTimeRangeCache::DateTimeRangeCache( const DateTimeParser & parser, int capacity, Clock clock ) : parser( parser ), capacity( capacity ), clock( clock ), first( 0 ), last( 0 ), hits( 0 ), misses( 0 ) {
+}
+
+DateTimeRangeCache::~DateTimeRangeCache() {
+    clear();
+}
+
+DateTimeRange DateTimeRangeCache::parseRange( const QStringRef & s ) {
+    const uint hash = normalizedHash( s );
+
+    {
+        QMutexLocker locker( &mutex );
+
+        if ( Entry * entry = find( s, hash ) ) {
+            if ( !entry->expires.isValid() || clock() < entry->expires ) {
+                ++ hits;
+
+                unlink( entry );
+                link( entry ); // Move to front as most recently used
+
+                return entry->range;
+            }
+
+            remove( entry ); // Stale
+        }
+
+        ++ misses;
+    }
+
+    const QDateTime parsed = clock(); // Taken before parsing, so range never outlives its minute or day
+
+    DateTimeParser::Relativity relativity;
+    const DateTimeRange range = parser.parseRange( s, &relativity );
+
+    QMutexLocker locker( &mutex );
+
+    if ( find( s, hash ) ) // Parsed by other thread meanwhile
+        return range;
+
+    Entry * entry = new Entry();
+    entry->hash = hash;
+    entry->range = range;
+    entry->expires = expiration( relativity, parsed );
+
+    NormalizedReader reader( s );
+
+    while ( !reader.atEnd() )
+        entry->expression.append( reader.next() );
+
+    entries.insert( hash, entry );
+    link( entry );
+
+    if ( entries.size() > capacity )
+        remove( last );
+
+    return range;
+}
+
+void DateTimeRangeCache::clear() {
+    QMutexLocker locker( &mutex );
+
+    while ( last )
+        remove( last );
+}
+
+int DateTimeRangeCache::hitCount() const {
+    QMutexLocker locker( &mutex );
+
+    return hits;
+}
+
+int DateTimeRangeCache::missCount() const {
+    QMutexLocker locker( &mutex );
+
+    return misses;
+}
+
+void DateTimeRangeCache::resetCounts() {
+    QMutexLocker locker( &mutex );
+
+    hits = misses = 0;
+}
+
+uint DateTimeRangeCache::normalizedHash( const QStringRef & s ) {
+    NormalizedReader reader( s );
+    uint h = 2166136261u; // FNV-1a
+
+    while ( !reader.atEnd() ) {
+        h ^= reader.next().unicode();
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+bool DateTimeRangeCache::normalizedEquals( const QString & normalized, const QStringRef & s ) {
+    NormalizedReader reader( s );
+
+    for ( int i = 0; i < normalized.length(); ++ i )
+        if ( reader.atEnd() || reader.next() != normalized[i] )
+            return false;
+
+    return reader.atEnd();
+}
+
+QDateTime DateTimeRangeCache::expiration( DateTimeParser::Relativity relativity, const QDateTime & parsed ) {
+    switch ( relativity ) {
+        case DateTimeParser::TimeRelative:
+            return QDateTime( parsed.date(), QTime( parsed.time().hour(), parsed.time().minute() ) ).addSecs( 60 );
+        case DateTimeParser::DayRelative:
+            return QDateTime( parsed.date().addDays( 1 ) );
+        default:
+            return QDateTime();
+    }
+}
+
+DateTimeRangeCache::Entry * DateTimeRangeCache::find( const QStringRef & s, uint hash ) const {
+    for ( QMultiHash<uint, Entry *>::const_iterator it = entries.constFind( hash ); it != entries.constEnd() && it.key() == hash; ++ it )
+        if ( normalizedEquals( it.value()->expression, s ) )
+            return it.value();
+
+    return 0;
+}
+
+void DateTimeRangeCache::link( Entry * entry ) {
+    entry->prev = 0;
+    entry->next = first;
+
+    if ( first )
+        first->prev = entry;
+    else
+        last = entry;
+
+    first = entry;
+}
+
+void DateTimeRangeCache::unlink( Entry * entry ) {
+    if ( entry->prev )
+        entry->prev->next = entry->next;
+    else
+        first = entry->next;
+
+    if ( entry->next )
+        entry->next->prev = entry->prev;
+    else
+        last = entry->prev;
+}
+
+void DateTimeRangeCache::remove( Entry * entry ) {
+    unlink( entry );
+    entries.remove( entry->hash, entry );
+
+    delete entry;
+}
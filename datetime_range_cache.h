@@ -0,0 +1,96 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATETIME_RANGE_CACHE_H
+#define DATETIME_RANGE_CACHE_H
+
+#include "datetime_parser.h"
+
+#include <QDateTime>
+#include <QMultiHash>
+#include <QMutex>
+
+/**
+  Bounded cache of parsed date/time ranges in front of parser. Expressions are
+  keyed with whitespace normalized, least recently used ranges are evicted first.
+  Ranges relative to current time expire when current minute or day rolls over.
+
+  Cache is thread-safe. Parsing itself is done outside of the lock.
+*/
+class DateTimeRangeCache {
+public:
+    typedef QDateTime (*Clock)(); // Source of current time, by which ranges expire
+
+    explicit DateTimeRangeCache( const DateTimeParser & parser, int capacity = 64, Clock clock = &QDateTime::currentDateTime );
+    ~DateTimeRangeCache();
+
+    DateTimeRange parseRange( const QStringRef & s );
+    DateTimeRange parseRange( const QString & s ) { return parseRange( QStringRef( &s ) ); }
+
+    void clear();
+
+    int hitCount() const;
+    int missCount() const;
+    void resetCounts();
+
+private:
+
+    struct Entry {
+        QString expression; // Normalized
+        uint hash;
+        DateTimeRange range;
+        QDateTime expires; // Invalid if range doesn't depend on current time
+        Entry * prev, * next; // Neighbours in order of use, most recent first
+    };
+
+private:
+
+    /**
+      Hash and comparison of expressions as if their whitespace was simplified
+    */
+    static uint normalizedHash( const QStringRef & s );
+    static bool normalizedEquals( const QString & normalized, const QStringRef & s );
+
+    /**
+      Time when range of given relativity, parsed at given time, becomes stale
+    */
+    static QDateTime expiration( DateTimeParser::Relativity relativity, const QDateTime & parsed );
+
+    Entry * find( const QStringRef & s, uint hash ) const;
+
+    void link( Entry * entry );
+    void unlink( Entry * entry );
+    void remove( Entry * entry );
+
+private:
+
+    const DateTimeParser & parser;
+    const int capacity;
+    const Clock clock;
+
+    mutable QMutex mutex; // Guards all fields below
+    QMultiHash<uint, Entry *> entries; // By normalized hash
+    Entry * first, * last;
+    int hits, misses;
+
+    Q_DISABLE_COPY( DateTimeRangeCache )
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "datetime_range_cache_test.h"
+#include "datetime_range_cache.h"
+
+static QDateTime fakeNow; // Current time seen by cache in expiry tests
+
+static QDateTime fakeClock() {
+    return fakeNow;
+}
+
+void DateTimeRangeCacheTest::testSameRanges() {
+    DateTimeRangeCache cache( parser );
+
+    DateTimeRange r1 = cache.parseRange( QString( "today from 12:00 to 13:00" ) );
+    DateTimeRange r2 = cache.parseRange( QString( "today from 12:00 to 13:00" ) );
+
+    QVERIFY( r1.start == parser.parseRange( "today from 12:00 to 13:00" ).start );
+    QVERIFY( r2.start == r1.start );
+    QVERIFY( r2.finish == r1.finish );
+
+    QCOMPARE( cache.missCount(), 1 );
+    QCOMPARE( cache.hitCount(), 1 );
+
+    cache.resetCounts();
+    cache.parseRange( QString( "today from 12:00 to 13:00" ) );
+
+    QCOMPARE( cache.missCount(), 0 ); // Entries are kept
+    QCOMPARE( cache.hitCount(), 1 );
+}
+
+void DateTimeRangeCacheTest::testNormalizedKeys() {
+    DateTimeRangeCache cache( parser );
+
+    cache.parseRange( QString( "from today to tomorrow" ) );
+    cache.parseRange( QString( "  from today \t to  tomorrow " ) );
+    cache.parseRange( QString( "from today to tomorrow 12:00" ) );
+
+    QCOMPARE( cache.missCount(), 2 );
+    QCOMPARE( cache.hitCount(), 1 );
+}
+
+void DateTimeRangeCacheTest::testEviction() {
+    DateTimeRangeCache cache( parser, 2 );
+
+    cache.parseRange( QString( "21.10.2009" ) );
+    cache.parseRange( QString( "22.10.2009" ) );
+    cache.parseRange( QString( "21.10.2009" ) ); // Now most recently used
+    cache.parseRange( QString( "23.10.2009" ) ); // Evicts 22.10.2009
+
+    QCOMPARE( cache.missCount(), 3 );
+
+    cache.parseRange( QString( "21.10.2009" ) );
+    QCOMPARE( cache.missCount(), 3 );
+
+    cache.parseRange( QString( "22.10.2009" ) );
+    QCOMPARE( cache.missCount(), 4 );
+}
+
+void DateTimeRangeCacheTest::testTimeRelativeExpiry() {
+    DateTimeRangeCache cache( parser, 64, &fakeClock );
+    const QDate today = QDate::currentDate();
+
+    fakeNow = QDateTime( today, QTime( 10, 0, 30 ) );
+    cache.parseRange( QString( "now" ) );
+    cache.parseRange( QString( "in 5 minutes" ) );
+    cache.parseRange( QString( "21.10.2009" ) );
+    QCOMPARE( cache.missCount(), 3 );
+
+    fakeNow = QDateTime( today, QTime( 10, 0, 59 ) );
+    cache.parseRange( QString( "now" ) );
+    cache.parseRange( QString( "in 5 minutes" ) );
+    QCOMPARE( cache.missCount(), 3 ); // Same minute
+
+    fakeNow = QDateTime( today, QTime( 10, 1, 0 ) );
+    cache.parseRange( QString( "now" ) );
+    cache.parseRange( QString( "in 5 minutes" ) );
+    QCOMPARE( cache.missCount(), 5 ); // Next minute
+
+    fakeNow = QDateTime( today.addDays( 3 ), QTime( 10, 1, 0 ) );
+    cache.parseRange( QString( "21.10.2009" ) );
+    QCOMPARE( cache.missCount(), 5 ); // Absolute range never expires
+}
+
+void DateTimeRangeCacheTest::testDayRelativeExpiry() {
+    DateTimeRangeCache cache( parser, 64, &fakeClock );
+    const QDate today = QDate::currentDate();
+
+    fakeNow = QDateTime( today, QTime( 0, 0 ) );
+    cache.parseRange( QString( "today" ) );
+    cache.parseRange( QString( "12:00" ) );
+    QCOMPARE( cache.missCount(), 2 );
+
+    fakeNow = QDateTime( today, QTime( 23, 59, 59 ) );
+    cache.parseRange( QString( "today" ) );
+    cache.parseRange( QString( "12:00" ) );
+    QCOMPARE( cache.missCount(), 2 ); // Same day, even many minutes later
+
+    fakeNow = QDateTime( today.addDays( 1 ), QTime( 0, 0 ) );
+    cache.parseRange( QString( "today" ) );
+    cache.parseRange( QString( "12:00" ) );
+    QCOMPARE( cache.missCount(), 4 ); // Next day
+}
+
+QTEST_MAIN(DateTimeRangeCacheTest)
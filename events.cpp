@@ -20,19 +20,19 @@
 
 #include "events.h"
 #include "events_config.h"
-#include "collection_selector.h"
+#include "akonadi_incidence_store.h"
+#include "item_cache.h"
+#include "keyword_trie.h"
+#include "metrics_registry.h"
+#include "runner_diagnostics.h"
+#include "top_k.h"
 
 #include <KDebug>
 #include <KMimeType>
+#include <KStandardDirs>
 
-#include <Akonadi/ItemFetchJob>
-#include <Akonadi/ItemFetchScope>
-#include <Akonadi/ItemCreateJob>
-#include <Akonadi/ItemModifyJob>
 #include <Akonadi/Item>
 
-#include <QEventLoop>
-
 #include <kcal/event.h>
 #include <kcal/todo.h>
 
@@ -51,6 +51,44 @@ static const QString commentKeyword( i18nc( "Event comment keyword", "comment" )
 static const QString eventsKeyword( i18nc( "Event list keyword", "events" ) );
 static const QString todosKeyword( i18nc( "Todo list keyword", "todos" ) );
 
+// Commands recognized by keywords, also positions of keywords in profile
+enum Command {
+    ShowEventsCommand,
+    ShowTodosCommand,
+    CreateEventCommand,
+    CreateTodoCommand,
+    CompleteTodoCommand,
+    CommentCommand
+};
+
+static QStringList profiledKeywords() {
+    return QStringList() << eventsKeyword << todosKeyword << eventKeyword << todoKeyword << completeKeyword << commentKeyword;
+}
+
+/**
+  Add keyword of command in English, its translation and translated aliases
+*/
+static void addKeywords( KeywordTrie & trie, Command command, const char * keyword, const QString & translated, const QString & aliases ) {
+    trie.insert( QLatin1String( keyword ), command ); // English keywords work with any translation
+    trie.insert( translated, command );
+
+    foreach ( const QString & alias, aliases.split( QLatin1Char( ',' ), QString::SkipEmptyParts ) )
+        trie.insert( alias.trimmed(), command );
+}
+
+static KeywordTrie commandKeywords() {
+    KeywordTrie trie;
+
+    addKeywords( trie, ShowEventsCommand, "events", eventsKeyword, i18nc( "Event list keyword aliases, separated by commas", "evs" ) );
+    addKeywords( trie, ShowTodosCommand, "todos", todosKeyword, i18nc( "Todo list keyword aliases, separated by commas", "tds" ) );
+    addKeywords( trie, CreateEventCommand, "event", eventKeyword, i18nc( "Event creation keyword aliases, separated by commas", "ev" ) );
+    addKeywords( trie, CreateTodoCommand, "todo", todoKeyword, i18nc( "Todo creation keyword aliases, separated by commas", "td" ) );
+    addKeywords( trie, CompleteTodoCommand, "complete", completeKeyword, i18nc( "Todo completion keyword aliases, separated by commas", "done" ) );
+    addKeywords( trie, CommentCommand, "comment", commentKeyword, i18nc( "Event comment keyword aliases, separated by commas", "note" ) );
+
+    return trie;
+}
+
 using namespace Akonadi;
 
 using Plasma::QueryMatch;
@@ -68,13 +106,126 @@ static QString dateTimeToString( const KDateTime & dt ) {
     return KGlobal::locale()->formatDateTime( dt );
 }
 
+/**
+  Local time of incidence record date, date-only for all-day incidences
+*/
+static KDateTime recordDateTime( const IncidenceRecord & record, qint64 time ) {
+    const KDateTime dt = IncidenceIndex::fromEpoch( time ).toLocalZone();
+
+    return ( record.flags & IncidenceRecord::AllDay ) ? KDateTime( dt.date() ) : dt;
+}
+
+/**
+  Date shown for incidence record: due date of todo or start of other incidences
+*/
+static QString recordDateString( const IncidenceRecord & record ) {
+    if ( record.kind == IncidenceRecord::Todo )
+        return ( record.flags & IncidenceRecord::HasDue ) ? dateTimeToString( recordDateTime( record, record.due ) ) : QString();
+
+    return ( record.flags & IncidenceRecord::HasStart ) ? dateTimeToString( recordDateTime( record, record.start ) ) : QString();
+}
+
+/**
+  Case-folded copy of query part, made in one allocation
+*/
+static QString caseFolded( const QStringRef & s ) {
+    QString folded;
+    folded.resize( s.length() );
+
+    QChar * chars = folded.data();
+
+    for ( int i = 0; i < s.length(); ++ i )
+        chars[i] = s.at( i ).toCaseFolded();
+
+    return folded;
+}
+
+static const int maxMatches = 10; // Number of matches shown for selection queries
+static const int cancellationCheckInterval = 256; // Number of scanned items between context validity checks
+
+/**
+  Closeness of incidence date to now, from 0 (far away) to 1 (right now)
+*/
+static qreal closeness( const IncidenceRecord & record, qint64 now ) {
+    qint64 date;
+
+    if ( record.flags & IncidenceRecord::HasDue )
+        date = record.due;
+    else if ( record.flags & IncidenceRecord::HasStart )
+        date = record.start;
+    else
+        return 0;
+
+    return 1.0 / ( 1.0 + qAbs( date - now ) / ( 7.0 * 24 * 3600 ) ); // Halves in a week
+}
+
+/**
+  Bonus for incomplete todos, so they are ranked first
+*/
+static qreal incompleteBonus( const IncidenceRecord & record ) {
+    return record.kind == IncidenceRecord::Todo && record.percentComplete < 100 ? 0.1 : 0;
+}
+
+static qreal textRelevance( const IncidenceRecord & record, const QString & foldedQuery, qint64 now ) {
+    const int index = record.summary.indexOf( foldedQuery );
+    qreal relevance = 0.5;
+
+    if ( index == 0 ) // Prefix match
+        relevance += record.summary.length() == foldedQuery.length() ? 0.25 : 0.2;
+    else if ( index > 0 && !record.summary[ index - 1 ].isLetterOrNumber() ) // Match at word boundary
+        relevance += 0.1;
+
+    return qMin( relevance + 0.1 * closeness( record, now ) + incompleteBonus( record ), 1.0 );
+}
+
+static qreal dateRelevance( const IncidenceRecord & record, qint64 now ) {
+    return qMin( 0.6 + 0.2 * closeness( record, now ) + incompleteBonus( record ), 1.0 );
+}
+
 EventsRunner::EventsRunner(QObject *parent, const QVariantList& args)
-    : Plasma::AbstractRunner(parent, args), cachedItemsLoaded( false )
+    : Plasma::AbstractRunner(parent, args), rangeCache( dateTimeParser ), keywords( commandKeywords() ), profiler( profiledKeywords() )
 {
     Q_UNUSED(args);
 
+    init( new AkonadiIncidenceStore( this ) );
+
+    itemCache->setIndexFile( KStandardDirs::locateLocal( "cache", QLatin1String( "plasma-runner-events/index" ) ) );
+
+    diagnostics->registerObject();
+}
+
+EventsRunner::EventsRunner( IncidenceStore * store, QObject * parent, const QString & indexFile )
+    : Plasma::AbstractRunner( parent ), rangeCache( dateTimeParser ), keywords( commandKeywords() ), profiler( profiledKeywords() )
+{
+    store->setParent( this );
+
+    init( store );
+
+    if ( !indexFile.isEmpty() )
+        itemCache->setIndexFile( indexFile );
+}
+
+void EventsRunner::init( IncidenceStore * store ) {
     setObjectName(RUNNER_NAME);
 
+    this->store = store;
+    itemCache = new ItemCache( store, metrics, this );
+    diagnostics = new RunnerDiagnostics( profiler, metrics, this );
+
+    warmQueryMetric = metrics.counter( "query.warm" );
+    coldQueryMetric = metrics.counter( "query.cold" );
+    scannedItemMetric = metrics.counter( "query.scanned-items" );
+    matchedItemMetric = metrics.counter( "query.matched-items" );
+    itemFetchMetric = metrics.counter( "fetch.single-items" );
+
+    connect( &metrics, SIGNAL( aboutToReport() ), this, SLOT( updateMetrics() ) );
+    connect( &metrics, SIGNAL( aboutToReset() ), this, SLOT( resetMetrics() ) );
+
+    connect( store, SIGNAL( itemFetched(Akonadi::Item,bool) ), this, SLOT( itemFetched(Akonadi::Item,bool) ) );
+
+    // Retry loading calendar if it wasn't loaded at startup
+    connect( this, SIGNAL( prepare() ), itemCache, SLOT( load() ) );
+
     icon = KIcon( QLatin1String( "text-calendar" ) );
 
     describeSyntaxes();
@@ -84,119 +235,178 @@ EventsRunner::EventsRunner(QObject *parent, const QVariantList& args)
 EventsRunner::~EventsRunner() {
 }
 
-void EventsRunner::reloadConfiguration() {
-    CollectionSelector * selector = new CollectionSelector( this );
-    connect( selector, SIGNAL( collectionsReceived(CollectionSelector &) ), this, SLOT( collectionsReceived(CollectionSelector &) ) );
-    selector->receiveCollections();
+void EventsRunner::dropQueryCaches() {
+    rangeCache.clear();
+
+    if ( lastTextSearch.hasLocalData() )
+        lastTextSearch.localData()->query.clear(); // Next search isn't taken as refinement of previous one
 }
 
-void EventsRunner::collectionsReceived( CollectionSelector & selector ) {
+void EventsRunner::reloadConfiguration() {
     KConfigGroup cfg = config();
 
-    todoCollection = selector.selectTodoCollection( cfg.readEntry( CONFIG_TODO_COLLECTION, (Collection::Id)0 ) );
-    eventCollection = selector.selectEventCollection( cfg.readEntry( CONFIG_TODO_COLLECTION, (Collection::Id)0 ) );
+    itemCache->setOccurrenceWindow( cfg.readEntry( CONFIG_OCCURRENCE_PAST_DAYS, 30 ), cfg.readEntry( CONFIG_OCCURRENCE_FUTURE_DAYS, 365 ) );
 
-    selector.deleteLater(); // No need to store it in memory anymore
+    store->configure( cfg ); // Cache is reloaded when store items change
 }
 
-Akonadi::Item::List EventsRunner::listAllItems() {
-    QMutexLocker locker( &cachedItemsMutex ); // Lock cachedItems access
+EventsRunner::RankedItemList EventsRunner::selectItems( const ItemCache::SnapshotPtr & snapshot, const Plasma::RunnerContext & context, const QStringRef & query, int kinds, QueryProfile & profile ) {
+    if ( query.length() < 3 )
+        return RankedItemList();
 
-    if ( !cachedItemsLoaded ) {
-        ItemFetchScope scope;
-        scope.fetchFullPayload( true );
+    const QString foldedQuery = caseFolded( query ); // Records contain case-folded summaries
+    const qint64 now = IncidenceIndex::toEpoch( KDateTime::currentUtcDateTime() );
 
-        ItemFetchJob job( todoCollection );
-        job.setFetchScope( scope );
+    const QVector<IncidenceRecord> & records = snapshot->index.records();
+    TopK<int> best( maxMatches );
 
-        QEventLoop loop;
+    if ( isCancelled( context, 0, records.size() ) ) // Don't search for query nobody waits for
+        return RankedItemList();
 
-        connect( &job, SIGNAL(finished( KJob * )), &loop, SLOT(quit()) );
+    if ( !lastTextSearch.hasLocalData() )
+        lastTextSearch.setLocalData( new TextSearch() );
 
-        job.start();
-        loop.exec();
+    TextSearch * last = lastTextSearch.localData();
 
-        cachedItemsLoaded = true;
-        cachedItems = job.items();
-    }
+    if ( last->generation == snapshot->generation && last->keyword == profile.keywordIndex() && !last->query.isEmpty() && foldedQuery.startsWith( last->query ) ) // Query was extended, so filter previous results
+        last->positions = snapshot->index.refine( last->positions, foldedQuery );
+    else
+        last->positions = snapshot->index.search( foldedQuery );
 
-    return cachedItems;
-}
+    last->generation = snapshot->generation;
+    last->keyword = profile.keywordIndex();
+    last->query = foldedQuery;
 
-Akonadi::Item::List EventsRunner::selectItems( const QString & query, const QStringList & mimeTypes ) {
-    Item::List matchedItems;
+    const QVector<int> & positions = last->positions;
 
-    if ( query.length() < 3 )
-        return matchedItems;
+    for ( int i = 0; i < positions.size(); ++ i ) {
+        if ( isCancelled( context, i, positions.size() ) )
+            return RankedItemList();
 
-    foreach ( const Item & item, listAllItems() ) {
-        if ( !mimeTypes.contains( item.mimeType() ) )
-            continue;
+        const IncidenceRecord & record = records[ positions[i] ];
 
-        if ( !item.hasPayload<KCal::Incidence::Ptr>() )
-            continue;
+        if ( record.kind & kinds )
+            best.add( textRelevance( record, foldedQuery, now ), positions[i] );
+    }
 
-        KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
+    RankedItemList result = rankedItems( best, snapshot );
+    profile.lap( MatchProfiler::Search );
 
-        if ( !incidence )
-            continue;
+    querySelected( snapshot, positions.size(), result.size() );
 
-        if ( incidence->summary().contains( query, Qt::CaseInsensitive ) )
-            matchedItems.append( item );
+    return result;
+}
 
-        if ( matchedItems.size() >= 10 ) // Stop search when too many are found
-            break;
-    }
+EventsRunner::RankedItemList EventsRunner::selectItems( const ItemCache::SnapshotPtr & snapshot, const Plasma::RunnerContext & context, const DateTimeRange & query, int kinds, QueryProfile & profile ) {
+    const qint64 from = IncidenceIndex::rangeStart( query );
+    const qint64 to = IncidenceIndex::rangeFinish( query );
+    const qint64 now = IncidenceIndex::toEpoch( KDateTime::currentUtcDateTime() );
 
-    return matchedItems;
-}
+    const QVector<IncidenceRecord> & records = snapshot->index.records();
+    const bool occurrencesIndexed = snapshot->index.coversRange( from, to );
+    TopK<int> best( maxMatches );
+
+    const QVector<int> positions = snapshot->index.searchRange( from, to );
+
+    for ( int i = 0; i < positions.size(); ++ i ) {
+        if ( isCancelled( context, i, positions.size() ) )
+            return RankedItemList();
 
-Akonadi::Item::List EventsRunner::selectItems( const DateTimeRange & query, const QStringList & mimeTypes ) {
-    Item::List matchedItems;
+        const IncidenceRecord & record = records[ positions[i] ];
 
-    foreach ( const Item & item, listAllItems() ) {
-        if ( !mimeTypes.contains( item.mimeType() ) )
+        if ( !( record.kind & kinds ) )
             continue;
 
-        if ( !item.hasPayload<KCal::Incidence::Ptr>() )
+        if ( ( record.flags & IncidenceRecord::Recurs ) && !occurrencesIndexed ) // Will be expanded below
             continue;
 
-        KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
+        best.add( dateRelevance( record, now ), positions[i] );
+    }
 
-        if ( !incidence )
-            continue;
+    if ( ( kinds & IncidenceRecord::Event ) && !occurrencesIndexed ) {
+        const QList<Item::Id> recurring = snapshot->index.recurringItems().toList();
 
-        if ( KCal::Todo * todo = dynamic_cast<KCal::Todo *>( incidence.get() ) ) {
-            if ( todo->hasStartDate() && todo->hasDueDate() && !query.intersects( todo->dtStart(), todo->dtDue() ) )
-                continue;
-            else if ( todo->hasStartDate() && !query.includes( todo->dtStart() ) )
-                continue;
-            else if ( todo->hasDueDate() && !query.includes( todo->dtDue() ) )
+        for ( int i = 0; i < recurring.size(); ++ i ) { // Range is outside of occurrence window, so expand from payload
+            if ( !context.isValid() ) { // Expansion is expensive, so check every time
+                queryCancelled( recurring.size() - i );
+                return RankedItemList();
+            }
+
+            const Item::Id id = recurring[i];
+            const int pos = snapshot->index.position( id );
+            const qreal relevance = dateRelevance( records[ pos ], now );
+
+            if ( !best.accepts( relevance ) )
                 continue;
-            else if ( !todo->hasDueDate() && !todo->hasStartDate() )
+
+            const Item item = snapshot->items.value( id );
+
+            if ( !item.hasPayload() ) // Restored item, not revalidated yet
                 continue;
-        } else if ( KCal::Event * event = dynamic_cast<KCal::Event *>( incidence.get() ) ) {
-            if ( event->recurs() ) {
-                if ( event->recurrence()->timesInInterval( query.start, query.finish ).empty() )
-                    continue;
-            } else {
-                if ( event->hasEndDate() && !query.intersects( event->dtStart(), event->dtEnd() ) )
-                    continue;
-                else if ( !query.includes( event->dtStart() ) )
-                    continue;
-            }
-        } else {
-            if ( !query.intersects( incidence->dtStart(), incidence->dtEnd() ) )
+
+            if ( item.payload<KCal::Incidence::Ptr>()->recurrence()->timesInInterval( query.start, query.finish ).empty() )
                 continue;
+
+            best.add( relevance, pos );
         }
+    }
+
+    RankedItemList result = rankedItems( best, snapshot );
+    profile.lap( MatchProfiler::Search );
+
+    querySelected( snapshot, positions.size(), result.size() );
+
+    return result;
+}
+
+void EventsRunner::querySelected( const ItemCache::SnapshotPtr & snapshot, int scanned, int matched ) {
+    ( snapshot->loaded ? warmQueryMetric : coldQueryMetric )->add( 1 );
+    scannedItemMetric->add( scanned );
+    matchedItemMetric->add( matched );
+}
+
+void EventsRunner::updateMetrics() {
+    metrics.gauge( "range-cache.hits" )->set( rangeCache.hitCount() );
+    metrics.gauge( "range-cache.misses" )->set( rangeCache.missCount() );
+    metrics.gauge( "query.cancelled" )->set( cancelledQueries );
+    metrics.gauge( "query.skipped-items" )->set( skippedScanItems );
+}
+
+void EventsRunner::resetMetrics() {
+    rangeCache.resetCounts();
+    cancelledQueries = 0;
+    skippedScanItems = 0;
+}
+
+bool EventsRunner::isCancelled( const Plasma::RunnerContext & context, int scanned, int total ) {
+    if ( scanned % cancellationCheckInterval != 0 || context.isValid() )
+        return false;
+
+    queryCancelled( total - scanned );
+
+    return true;
+}
 
-        matchedItems.append( item );
+void EventsRunner::queryCancelled( int skippedItems ) {
+    cancelledQueries.ref();
+    skippedScanItems.fetchAndAddRelaxed( skippedItems );
+}
+
+EventsRunner::RankedItemList EventsRunner::rankedItems( const TopK<int> & best, const ItemCache::SnapshotPtr & snapshot ) {
+    RankedItemList result;
+
+    typedef QPair<qreal, int> RankedPosition;
 
-        if ( matchedItems.size() >= 10 ) // Stop search when too many are found
-            break;
+    foreach ( const RankedPosition & position, best.results() ) {
+        RankedItem ranked;
+        ranked.relevance = position.first;
+        ranked.record = snapshot->index.records()[ position.second ];
+        ranked.item = snapshot->items.value( ranked.record.id );
+
+        result.append( ranked );
     }
 
-    return matchedItems;
+    return result;
 }
 
 void EventsRunner::describeSyntaxes() {
@@ -222,30 +432,48 @@ void EventsRunner::describeSyntaxes() {
     eventsSyntax.setSearchTermDescription( i18n( "event date/time" ) );
     syntaxes.append(eventsSyntax);
 
-    RunnerSyntax todosSyntax( QString("%1 :q:").arg( eventsKeyword ), i18n("Shows todos from calendar by its date in :q:.") );
+    RunnerSyntax todosSyntax( QString("%1 :q:").arg( todosKeyword ), i18n("Shows todos from calendar by its date in :q:.") );
     todosSyntax.setSearchTermDescription( i18n( "todo date/time" ) );
     syntaxes.append(todosSyntax);
 
     setSyntaxes(syntaxes);
 }
 
-QStringList EventsRunner::splitArguments( const QString & str ) {
-    QStringList args = str.split(';');
+EventsRunner::ArgumentList EventsRunner::splitArguments( const QStringRef & str ) const {
+    ArgumentList args;
+
+    const QChar * chars = str.unicode();
+    int start = 0;
+
+    for ( int i = 0; i <= str.length(); ++ i ) {
+        if ( i < str.length() && chars[i] != ';' )
+            continue;
+
+        // Trim argument
+        int first = start, last = i;
+
+        while ( first < last && chars[first].isSpace() )
+            ++ first;
 
-    for ( QStringList::Iterator it = args.begin(); it != args.end(); ++it ) {
-        *it = (*it).trimmed(); // Trim all arguments
+        while ( last > first && chars[last - 1].isSpace() )
+            -- last;
+
+        args.append( QStringRef( str.string(), str.position() + first, last - first ) );
+        start = i + 1;
     }
 
     return args;
 }
 
-QueryMatch EventsRunner::createQueryMatch( const QString & definition, MatchType type ) {
-    QStringList args = splitArguments( definition );
+QueryMatch EventsRunner::createQueryMatch( const QStringRef & definition, MatchType type, QueryProfile & profile ) {
+    const ArgumentList args = splitArguments( definition );
+    profile.lap( MatchProfiler::SplitArguments );
 
     if ( args.size() < 2 || args[0].length() < 3 || args[1].length() < 3 )
         return QueryMatch( 0 ); // Return invalid match if not enough arguments
 
-    DateTimeRange range = dateTimeParser.parseRange( args[1].trimmed() );
+    DateTimeRange range = rangeCache.parseRange( args[1] );
+    profile.lap( MatchProfiler::ParseRange );
 
     if ( !range.start.isValid() || !range.finish.isValid() )
         return QueryMatch( 0 ); // Return invalid match if date is invalid
@@ -253,12 +481,12 @@ QueryMatch EventsRunner::createQueryMatch( const QString & definition, MatchType
     QMap<QString,QVariant> data; // Map for data
 
     data["type"] = type;
-    data["summary"] = args[0];
+    data["summary"] = args[0].toString();
     data["start"] = dateTimeToVariant( range.start );
     data["finish"] = dateTimeToVariant( range.finish );
 
-    if ( args.length() > 2 && !args[2].isEmpty() ) // If categories info present
-        data["categories"] = args[2];
+    if ( args.size() > 2 && !args[2].isEmpty() ) // If categories info present
+        data["categories"] = args[2].toString();
 
     QueryMatch match( this );
 
@@ -268,14 +496,14 @@ QueryMatch EventsRunner::createQueryMatch( const QString & definition, MatchType
         else
             match.setText( i18n( "Create event \"%1\" from %2 to %3", data["summary"].toString(), dateTimeToString( range.start ), dateTimeToString( range.finish ) ) );
 
-        match.setId( eventKeyword + '|' + definition );
+        match.setId( eventKeyword + '|' + definition.toString() );
     } else if ( type == CreateTodo ) {
         if ( range.isPoint() )
             match.setText( i18n( "Create todo \"%1\" due to %2", data["summary"].toString(), dateTimeToString( range.finish ) ) );
         else
             match.setText( i18n( "Create todo \"%1\" due to %3 starting at %2", data["summary"].toString(), dateTimeToString( range.start ), dateTimeToString( range.finish ) ) );
 
-        match.setId( todoKeyword + '|' + definition );
+        match.setId( todoKeyword + '|' + definition.toString() );
     } else {
         qDebug() << "Unknown match type: " << type;
 
@@ -298,7 +526,7 @@ QueryMatch EventsRunner::createQueryMatch( const QString & definition, MatchType
     return match;
 }
 
-Plasma::QueryMatch EventsRunner::createUpdateMatch( const Item & item, MatchType type, const QStringList & args ) {
+Plasma::QueryMatch EventsRunner::createUpdateMatch( const RankedItem & ranked, MatchType type, const ArgumentList & args ) {
     QueryMatch match( this );
 
     QMap<QString,QVariant> data; // Map for data
@@ -306,29 +534,22 @@ Plasma::QueryMatch EventsRunner::createUpdateMatch( const Item & item, MatchType
     data["type"] = type;
 
     if ( type == CompleteTodo ) {
-        KCal::Todo::Ptr todo = item.payload<KCal::Todo::Ptr>();
-
-        match.setText( i18n( "Complete todo \"%1\"", todo->summary() ) );
-        match.setSubtext( i18n( "Date: %1", dateTimeToString( todo->dtDue() ) ) );
+        match.setText( i18n( "Complete todo \"%1\"", ranked.record.title ) );
+        match.setSubtext( i18n( "Date: %1", recordDateString( ranked.record ) ) );
 
-        data["item"] = qVariantFromValue( item );
-        data["percent"] = args.size() > 1 ? args[1].toInt() : 100; // Set percent complete to specified or 100 by default
+        data["item"] = qVariantFromValue( ranked.item );
+        data["percent"] = args.size() > 1 ? args[1].toString().toInt() : 100; // Set percent complete to specified or 100 by default
     } else if ( type == CommentIncidence ) {
         if ( args.size() < 2 ) // There is no comment - skip match
             return QueryMatch( 0 );
 
-        KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
+        match.setText( i18n( "Comment incidence \"%1\"", ranked.record.title ) );
 
-        match.setText( i18n( "Comment incidence \"%1\"", incidence->summary() ) );
+        if ( ranked.record.kind != IncidenceRecord::Other )
+            match.setSubtext( i18n( "Date: %1", recordDateString( ranked.record ) ) );
 
-        if ( KCal::Todo * todo = dynamic_cast<KCal::Todo *>( incidence.get() ) ) {
-            match.setSubtext( i18n( "Date: %1", dateTimeToString( todo->dtDue() ) ) );
-        } else if ( KCal::Event * event = dynamic_cast<KCal::Event *>( incidence.get() ) ) {
-            match.setSubtext( i18n( "Date: %1", dateTimeToString( event->dtStart() ) ) );
-        }
-
-        data["item"] = qVariantFromValue( item );
-        data["comment"] = args[1];
+        data["item"] = qVariantFromValue( ranked.item );
+        data["comment"] = args[1].toString();
     } else {
         qDebug() << "Unknown match type: " << type;
 
@@ -336,14 +557,32 @@ Plasma::QueryMatch EventsRunner::createUpdateMatch( const Item & item, MatchType
     }
 
     match.setData( data );
-    match.setRelevance( 0.8 );
+    match.setRelevance( ranked.relevance );
     match.setIcon( icon );
-    match.setId( QString("update-%1-%2").arg( item.id() ).arg( type )  );
+    match.setId( QString("update-%1-%2").arg( ranked.item.id() ).arg( type )  );
 
     return match;
 }
 
-Plasma::QueryMatch EventsRunner::createShowMatch( const Item & item, MatchType type, const DateTimeRange & range ) {
+QList<KDateTime> EventsRunner::occurrences( const ItemCache::SnapshotPtr & snapshot, const RankedItem & ranked, const DateTimeRange & range ) {
+    QVector<qint64> times;
+
+    if ( !snapshot->index.occurrences( ranked.record.id, IncidenceIndex::rangeStart( range ), IncidenceIndex::rangeFinish( range ), times ) ) { // Not indexed, so expand it
+        if ( !ranked.item.hasPayload() )
+            return QList<KDateTime>();
+
+        return ranked.item.payload<KCal::Incidence::Ptr>()->recurrence()->timesInInterval( range.start, range.finish );
+    }
+
+    QList<KDateTime> result;
+
+    foreach ( qint64 time, times )
+        result.append( recordDateTime( ranked.record, time ) );
+
+    return result;
+}
+
+Plasma::QueryMatch EventsRunner::createShowMatch( const ItemCache::SnapshotPtr & snapshot, const RankedItem & ranked, MatchType type, const DateTimeRange & range ) {
     QueryMatch match( this );
 
     QMap<QString,QVariant> data; // Map for data
@@ -351,30 +590,26 @@ Plasma::QueryMatch EventsRunner::createShowMatch( const Item & item, MatchType t
     data["type"] = type;
 
     if ( type == ShowIncidence ) {
-        KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
-
-        match.setText( incidence->summary() );
+        const IncidenceRecord & record = ranked.record;
 
-        if ( KCal::Todo * todo = dynamic_cast<KCal::Todo *>( incidence.get() ) ) {
-            match.setSubtext( i18n( "Date: %1", dateTimeToString( todo->dtDue() ) ) );
-        } else if ( KCal::Event * event = dynamic_cast<KCal::Event *>( incidence.get() ) ) {
-            if ( event->recurs() ) {
-                QString dates = "";
+        match.setText( record.title );
 
-                foreach ( const KDateTime & dt, event->recurrence()->timesInInterval( range.start, range.finish ) ) {
-                    if ( !dates.isEmpty() )
-                        dates += ", ";
+        if ( record.flags & IncidenceRecord::Recurs ) {
+            QString dates = "";
 
-                    dates += dateTimeToString( dt );
-                }
+            foreach ( const KDateTime & dt, occurrences( snapshot, ranked, range ) ) {
+                if ( !dates.isEmpty() )
+                    dates += ", ";
 
-                match.setSubtext( i18n( "Date: %1", dates ) );
-            } else {
-                match.setSubtext( i18n( "Date: %1", dateTimeToString( event->dtStart() ) ) );
+                dates += dateTimeToString( dt );
             }
+
+            match.setSubtext( i18n( "Date: %1", dates ) );
+        } else if ( record.kind != IncidenceRecord::Other ) {
+            match.setSubtext( i18n( "Date: %1", recordDateString( record ) ) );
         }
 
-        data["item"] = qVariantFromValue( item );
+        data["item"] = qVariantFromValue( ranked.item );
     } else {
         qDebug() << "Unknown match type: " << type;
 
@@ -382,77 +617,120 @@ Plasma::QueryMatch EventsRunner::createShowMatch( const Item & item, MatchType t
     }
 
     match.setData( data );
-    match.setRelevance( 0.8 );
+    match.setRelevance( ranked.relevance );
     match.setIcon( icon );
-    match.setId( QString("update-%1-%2").arg( item.id() ).arg( type )  );
+    match.setId( QString("update-%1-%2").arg( ranked.item.id() ).arg( type )  );
 
     return match;
 }
 
+void EventsRunner::addLoadingMatch( Plasma::RunnerContext &context ) {
+    QueryMatch match( this );
+
+    QMap<QString,QVariant> data; // Map for data
+
+    data["type"] = CacheLoading;
+
+    match.setType( QueryMatch::InformationalMatch );
+    match.setText( i18n( "Calendar is loading..." ) );
+    match.setData( data );
+    match.setRelevance( 0.1 );
+    match.setIcon( icon );
+    match.setId( "loading" );
+
+    context.addMatch( context.query(), match );
+}
+
 void EventsRunner::match( Plasma::RunnerContext &context ) {
     const QString term = context.query();
 
-    if ( term.length() < 8 )
+    if ( term.length() < keywords.minimumLength() + 2 ) // Keyword, separator and some argument
         return;
 
-    if ( term.startsWith( eventsKeyword ) ) {
-        QStringList args = splitArguments( term.mid( eventsKeyword.length() ) );
-        DateTimeRange range = dateTimeParser.parseRange( args[0].trimmed() );
+    QueryProfile profile( profiler );
 
-        if ( range.isValid() ) {
-            Item::List items = selectItems( range, QStringList( eventMimeType ) );
+    int keywordLength = 0;
+    const int command = keywords.find( term, keywordLength );
 
-            foreach ( const Item & item, items ) {
-                QueryMatch match = createShowMatch( item, ShowIncidence, range );
+    if ( command < 0 || term.length() < keywordLength + 2 ) {
+        profile.lap( MatchProfiler::Dispatch );
+        return;
+    }
 
-                if ( match.isValid() )
-                    context.addMatch( term, match );
-            }
-        }
-    } else if ( term.startsWith( todosKeyword ) ) {
-        QStringList args = splitArguments( term.mid( todosKeyword.length() ) );
-        DateTimeRange range = dateTimeParser.parseRange( args[0].trimmed() );
+    profile.setKeyword( command );
+    profile.lap( MatchProfiler::Dispatch );
+
+    const QStringRef arguments = term.midRef( keywordLength );
+
+    switch ( command ) {
+    case ShowEventsCommand:
+    case ShowTodosCommand: {
+        const ArgumentList args = splitArguments( arguments );
+        profile.lap( MatchProfiler::SplitArguments );
+
+        DateTimeRange range = rangeCache.parseRange( args[0] );
+        profile.lap( MatchProfiler::ParseRange );
 
         if ( range.isValid() ) {
-            Item::List items = selectItems( range, QStringList( todoMimeType ) );
+            const ItemCache::SnapshotPtr snapshot = itemCache->snapshot(); // Whole query is answered from it, and it keeps items alive
+            profile.lap( MatchProfiler::Snapshot );
+
+            const RankedItemList items = selectItems( snapshot, context, range, command == ShowEventsCommand ? IncidenceRecord::Event : IncidenceRecord::Todo, profile );
 
-            foreach ( const Item & item, items ) {
-                QueryMatch match = createShowMatch( item, ShowIncidence, range );
+            foreach ( const RankedItem & ranked, items ) {
+                if ( !context.isValid() ) // Don't build matches nobody will see
+                    return;
+
+                QueryMatch match = createShowMatch( snapshot, ranked, ShowIncidence, range );
 
                 if ( match.isValid() )
                     context.addMatch( term, match );
             }
+
+            if ( !snapshot->loaded )
+                addLoadingMatch( context );
+
+            profile.lap( MatchProfiler::CreateMatches );
         }
-    } else if ( term.startsWith( eventKeyword ) ) {
-        QueryMatch match = createQueryMatch( term.mid( eventKeyword.length() ), CreateEvent );
+        break;
+    }
+    case CreateEventCommand:
+    case CreateTodoCommand: {
+        QueryMatch match = createQueryMatch( arguments, command == CreateEventCommand ? CreateEvent : CreateTodo, profile );
 
         if ( match.isValid() )
             context.addMatch( term, match );
-    } else if ( term.startsWith( todoKeyword ) ) {
-        QueryMatch match = createQueryMatch( term.mid( eventKeyword.length() ), CreateTodo );
 
-        if ( match.isValid() )
-            context.addMatch( term, match );
-    } else if ( term.startsWith( completeKeyword ) ) {
-        QStringList args = splitArguments( term.mid( completeKeyword.length() ) );
-        Item::List items = selectItems( args[0], QStringList( todoMimeType ) );
+        profile.lap( MatchProfiler::CreateMatches );
+        break;
+    }
+    case CompleteTodoCommand:
+    case CommentCommand: {
+        const ArgumentList args = splitArguments( arguments );
+        profile.lap( MatchProfiler::SplitArguments );
 
-        foreach ( const Item & item, items ) {
-            QueryMatch match = createUpdateMatch( item, CompleteTodo, args );
+        const ItemCache::SnapshotPtr snapshot = itemCache->snapshot(); // Whole query is answered from it, and it keeps items alive
+        profile.lap( MatchProfiler::Snapshot );
 
-            if ( match.isValid() )
-                context.addMatch( term, match );
-        }
-    } else if ( term.startsWith( commentKeyword ) ) {
-        QStringList args = splitArguments( term.mid( commentKeyword.length() ) );
-        Item::List items = selectItems( args[0], QStringList( todoMimeType ) << eventMimeType );
+        const bool complete = command == CompleteTodoCommand;
+        const RankedItemList items = selectItems( snapshot, context, args[0], complete ? IncidenceRecord::Todo : IncidenceRecord::Todo | IncidenceRecord::Event, profile );
+
+        foreach ( const RankedItem & ranked, items ) {
+            if ( !context.isValid() ) // Don't build matches nobody will see
+                return;
 
-        foreach ( const Item & item, items ) {
-            QueryMatch match = createUpdateMatch( item, CommentIncidence, args );
+            QueryMatch match = createUpdateMatch( ranked, complete ? CompleteTodo : CommentIncidence, args );
 
             if ( match.isValid() )
                 context.addMatch( term, match );
         }
+
+        if ( !snapshot->loaded )
+            addLoadingMatch( context );
+
+        profile.lap( MatchProfiler::CreateMatches );
+        break;
+    }
     }
 }
 
@@ -462,11 +740,6 @@ void EventsRunner::run(const Plasma::RunnerContext &context, const Plasma::Query
     QMap<QString,QVariant> data = match.data().toMap();
 
     if ( data["type"].toInt() == CreateEvent ) {
-        if ( !eventCollection.isValid() ) {
-            qDebug() << "No valid collection for events available";
-            return;
-        }
-
         KCal::Event::Ptr event( new KCal::Event() );
         event->setSummary( data["summary"].toString() );
 
@@ -479,16 +752,9 @@ void EventsRunner::run(const Plasma::RunnerContext &context, const Plasma::Query
         if ( data.contains("categories") ) // Set categories if present
             event->setCategories( data["categories"].toString() );
 
-        Item item( eventMimeType );
-        item.setPayload<KCal::Event::Ptr>( event );
-
-        new Akonadi::ItemCreateJob( item, eventCollection, this );
+        if ( !store->create( event ) )
+            qDebug() << "No valid collection for events available";
     } else if ( data["type"].toInt() == CreateTodo ) {
-        if ( !todoCollection.isValid() ) {
-            qDebug() << "No valid collection for todos available";
-            return;
-        }
-
         KCal::Todo::Ptr todo( new KCal::Todo() );
         todo->setSummary( data["summary"].toString() );
         todo->setPercentComplete( 0 );
@@ -506,36 +772,60 @@ void EventsRunner::run(const Plasma::RunnerContext &context, const Plasma::Query
         if ( data.contains("categories") ) // Set categories if present
             todo->setCategories( data["categories"].toString() );
 
-        Item item( todoMimeType );
-        item.setPayload<KCal::Todo::Ptr>( todo );
-
-        new Akonadi::ItemCreateJob( item, todoCollection, this );
-    } else if ( data["type"].toInt() == CompleteTodo ) {
-        Item item = data["item"].value<Item>(); // Retrieve item
-        KCal::Todo::Ptr todo = item.payload<KCal::Todo::Ptr>(); // Retrieve item payload - todo
+        if ( !store->create( todo ) )
+            qDebug() << "No valid collection for todos available";
+    } else if ( data["type"].toInt() == CompleteTodo || data["type"].toInt() == CommentIncidence ) {
+        const Item item = data["item"].value<Item>(); // Retrieve item
 
-        todo->setPercentComplete( data["percent"].toInt() ); // Set item percent completed
+        // Cache keeps no full payloads, so fetch current item right before modifying it
+        pendingUpdates.insert( item.id(), data );
+        store->fetchItem( item.id() );
+        itemFetchMetric->add( 1 );
+    } else if ( data["type"].toInt() == ShowIncidence ) {
+        // Do nothing yet
+    } else if ( data["type"].toInt() == CacheLoading ) {
+        // Nothing to do, just a hint
+    } else {
+        qDebug() << "Unknown match type: " << data["type"];
+    }
+}
 
-        ItemModifyJob * job = new ItemModifyJob( item, this );
+void EventsRunner::applyUpdate( const KCal::Incidence::Ptr & incidence, const QMap<QString,QVariant> & data ) {
+    if ( data["type"].toInt() == CompleteTodo ) {
+        KCal::Todo * todo = dynamic_cast<KCal::Todo *>( incidence.get() );
 
-        job->setIgnorePayload( false ); // Update payload!!
+        if ( todo )
+            todo->setPercentComplete( data["percent"].toInt() ); // Set item percent completed
     } else if ( data["type"].toInt() == CommentIncidence ) {
-        Item item = data["item"].value<Item>(); // Retrieve item
-        KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>(); // Retrieve item payload - incidence
-
         if ( incidence->descriptionIsRich() ) {
             incidence->setDescription( incidence->richDescription() + "\n\n" + data["comment"].toString(), true);
         } else {
             incidence->setDescription( incidence->description() + "\n\n" + data["comment"].toString());
         }
+    }
+}
 
-        ItemModifyJob * job = new ItemModifyJob( item, this );
+void EventsRunner::itemFetched( const Item & item, bool success ) {
+    const QList< QMap<QString,QVariant> > updates = pendingUpdates.values( item.id() );
 
-        job->setIgnorePayload( false ); // Update payload!!
-    } else if ( data["type"].toInt() == ShowIncidence ) {
-        // Do nothing yet
-    } else {
-        qDebug() << "Unknown match type: " << data["type"];
+    pendingUpdates.remove( item.id() );
+
+    if ( updates.isEmpty() ) // Already applied along with update fetched earlier
+        return;
+
+    if ( !success || !item.hasPayload<KCal::Incidence::Ptr>() ) {
+        qDebug() << "Failed to fetch item" << item.id() << "for update";
+        return;
     }
-}
 
+    // All updates go to a single copy of payload, so they make single modification of fetched revision
+    KCal::Incidence::Ptr incidence( item.payload<KCal::Incidence::Ptr>()->clone() );
+
+    for ( int i = updates.size() - 1; i >= 0; -- i ) // Values are returned from the most recent one
+        applyUpdate( incidence, updates[i] );
+
+    Item modified( item );
+    modified.setPayload<KCal::Incidence::Ptr>( incidence );
+
+    store->modify( modified );
+}
@@ -22,18 +22,29 @@
 #define EVENTS_H
 
 #include "datetime_parser.h"
+#include "datetime_range_cache.h"
+#include "item_cache.h"
+#include "keyword_trie.h"
+#include "match_profiler.h"
+#include "metrics_registry.h"
+#include "top_k.h"
 
 #include <Plasma/AbstractRunner>
 
-#include <Akonadi/Collection>
 #include <Akonadi/Item>
 
+#include <kcal/incidence.h>
+
 #include <KIcon>
 
+#include <QAtomicInt>
+#include <QHash>
 #include <QMap>
-#include <QMutex>
+#include <QThreadStorage>
+#include <QVarLengthArray>
 
-class CollectionSelector;
+class IncidenceStore;
+class RunnerDiagnostics;
 
 /**
 */
@@ -43,6 +54,12 @@ class EventsRunner : public Plasma::AbstractRunner {
 public:
     // Basic Create/Destroy
     EventsRunner( QObject *parent, const QVariantList& args );
+
+    /**
+      Create runner working with given store instead of Akonadi, takes ownership of the store
+    */
+    EventsRunner( IncidenceStore * store, QObject * parent, const QString & indexFile = QString() );
+
     ~EventsRunner();
 
     void match(Plasma::RunnerContext &context);
@@ -50,12 +67,40 @@ public:
 
     void reloadConfiguration();
 
+    /**
+      Number of queries, which scan was aborted because their context became
+      invalid, since metrics were reset
+    */
+    int cancelledQueryCount() const { return cancelledQueries; }
+
+    /**
+      Number of items, which scan was skipped due to aborted queries, since
+      metrics were reset
+    */
+    int skippedScanItemCount() const { return skippedScanItems; }
+
+    /**
+      Forget parsed ranges and previous text search of the calling thread, so
+      next query is answered cold
+    */
+    void dropQueryCaches();
+
 private slots:
 
     /**
-      Called when Akonadi collections loaded
+      Apply updates which were waiting for full item payload
     */
-    void collectionsReceived( CollectionSelector & selector );
+    void itemFetched( const Akonadi::Item & item, bool success );
+
+    /**
+      Sample runner statistics before metrics are reported
+    */
+    void updateMetrics();
+
+    /**
+      Clear statistics sampled into metrics along with metric counters
+    */
+    void resetMetrics();
 
 private:
 
@@ -64,36 +109,110 @@ private:
         CreateTodo,
         CompleteTodo,
         CommentIncidence,
-        ShowIncidence
+        ShowIncidence,
+        CacheLoading
+    };
+
+    typedef QVarLengthArray<QStringRef, 8> ArgumentList; // Arguments refer to query text
+
+    /**
+      Selected item with its search record. Item may have no payload, so matches
+      are described by the record
+    */
+    struct RankedItem {
+        qreal relevance;
+        IncidenceRecord record;
+        Akonadi::Item item;
+    };
+
+    typedef QList<RankedItem> RankedItemList;
+
+    /**
+      Result of the last text search in match thread, which is refined
+      when user continues typing the same query after the same keyword
+    */
+    struct TextSearch {
+        TextSearch() : generation( -1 ), keyword( -1 ) {}
+
+        int generation; // Snapshot in which positions are valid, which isn't kept alive
+        int keyword;
+        QString query;
+        QVector<int> positions;
     };
 
 private:
 
-    QStringList splitArguments( const QString & str );
+    void init( IncidenceStore * store );
+
+    /**
+      Split query arguments separated by ';' and trim them, without copying query text
+    */
+    ArgumentList splitArguments( const QStringRef & str ) const;
+
+    /**
+      Select most relevant items by text query from given snapshot, best first
+    */
+    RankedItemList selectItems( const ItemCache::SnapshotPtr & snapshot, const Plasma::RunnerContext & context, const QStringRef & query, int kinds, QueryProfile & profile );
+
+    RankedItemList selectItems( const ItemCache::SnapshotPtr & snapshot, const Plasma::RunnerContext & context, const DateTimeRange & query, int kinds, QueryProfile & profile );
 
     /**
-      Select items by text query synchroniously
+      Periodically check while scanning if query is still needed, counting aborted query if not
     */
-    Akonadi::Item::List selectItems( const QString & query, const QStringList & mimeTypes );
+    bool isCancelled( const Plasma::RunnerContext & context, int scanned, int total );
 
-    Akonadi::Item::List selectItems( const DateTimeRange & query, const QStringList & mimeTypes );
+    void queryCancelled( int skippedItems );
+
+    /**
+      Count query answered from given snapshot, with number of scanned and matched items
+    */
+    void querySelected( const ItemCache::SnapshotPtr & snapshot, int scanned, int matched );
 
-    Akonadi::Item::List listAllItems();
+    RankedItemList rankedItems( const TopK<int> & best, const ItemCache::SnapshotPtr & snapshot );
 
-    Plasma::QueryMatch createQueryMatch( const QString & definition, MatchType type );
-    Plasma::QueryMatch createUpdateMatch( const Akonadi::Item & item, MatchType type, const QStringList & args );
-    Plasma::QueryMatch createShowMatch( const Akonadi::Item & item, MatchType type, const DateTimeRange & range );
+    Plasma::QueryMatch createQueryMatch( const QStringRef & definition, MatchType type, QueryProfile & profile );
+    Plasma::QueryMatch createUpdateMatch( const RankedItem & ranked, MatchType type, const ArgumentList & args );
+    Plasma::QueryMatch createShowMatch( const ItemCache::SnapshotPtr & snapshot, const RankedItem & ranked, MatchType type, const DateTimeRange & range );
+
+    /**
+      Occurrences of recurring item in range, taken from index of the snapshot it was selected from when possible
+    */
+    QList<KDateTime> occurrences( const ItemCache::SnapshotPtr & snapshot, const RankedItem & ranked, const DateTimeRange & range );
+
+    /**
+      Complete todo or comment incidence in given payload
+    */
+    void applyUpdate( const KCal::Incidence::Ptr & incidence, const QMap<QString,QVariant> & data );
+
+    /**
+      Add hint that calendar items are still loading, so results may be incomplete
+    */
+    void addLoadingMatch( Plasma::RunnerContext & context );
 
     void describeSyntaxes();
 
 private:
 
     DateTimeParser dateTimeParser;
+    DateTimeRangeCache rangeCache; // Parsed ranges of recent queries
+
+    KeywordTrie keywords; // Commands by their keywords and aliases
+
+    MatchProfiler profiler;
+    MetricsRegistry metrics;
+    Metric * warmQueryMetric, * coldQueryMetric; // Queries answered from loaded and still loading cache
+    Metric * scannedItemMetric, * matchedItemMetric;
+    Metric * itemFetchMetric;
+    RunnerDiagnostics * diagnostics;
+
+    IncidenceStore * store;
+    ItemCache * itemCache;
+    QThreadStorage<TextSearch *> lastTextSearch;
+
+    QMultiHash<Akonadi::Item::Id, QMap<QString,QVariant> > pendingUpdates; // Updates of items which payload is being fetched
 
-    Akonadi::Collection eventCollection, todoCollection;
-    Akonadi::Item::List cachedItems;
-    bool cachedItemsLoaded;
-    QMutex cachedItemsMutex;
+    QAtomicInt cancelledQueries;
+    QAtomicInt skippedScanItems;
 
     KIcon icon;
 };
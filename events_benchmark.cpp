@@ -0,0 +1,333 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "events_benchmark.h"
+#include "events.h"
+#include "local_incidence_store.h"
+
+#include <Plasma/RunnerContext>
+
+#include <kcal/event.h>
+#include <kcal/todo.h>
+
+#include <qtest_kde.h>
+
+#include <cstdlib>
+
+#ifdef __GLIBC__
+
+// Count heap allocations of the whole process by wrapping glibc allocator
+
+static int allocationCount = 0; // Plain int, as allocator may be called before static constructors
+
+extern "C" {
+    void * __libc_malloc( size_t size );
+    void * __libc_calloc( size_t count, size_t size );
+    void * __libc_realloc( void * ptr, size_t size );
+
+    void * malloc( size_t size ) __THROW {
+        __sync_fetch_and_add( &allocationCount, 1 );
+        return __libc_malloc( size );
+    }
+
+    void * calloc( size_t count, size_t size ) __THROW {
+        __sync_fetch_and_add( &allocationCount, 1 );
+        return __libc_calloc( count, size );
+    }
+
+    void * realloc( void * ptr, size_t size ) __THROW {
+        __sync_fetch_and_add( &allocationCount, 1 );
+        return __libc_realloc( ptr, size );
+    }
+}
+
+static int allocations() {
+    return __sync_fetch_and_add( &allocationCount, 0 );
+}
+
+#else
+
+static int allocations() {
+    return 0; // Not counted on this platform
+}
+
+#endif
+
+static const char * const words[] = {
+    "buy", "call", "meeting", "project", "review", "report", "dentist", "birthday",
+    "deadline", "release", "phone", "groceries", "travel", "tickets", "budget", "party"
+};
+
+static const int wordCount = sizeof( words ) / sizeof( words[0] );
+
+// Heap allocations allowed in a cold query besides its matches: cached range, search results and ranked items
+static const int maxQueryAllocations = 64;
+
+// Heap allocations allowed for each built match, which copies its text and data
+static const int maxMatchAllocations = 64;
+
+static const int occurrencePastDays = 30; // Same window as runner uses by default
+static const int occurrenceFutureDays = 365;
+
+EventsBenchmark::EventsBenchmark() {
+    // Percent of recurring events in generated calendars
+    bool ok;
+    recurringPercent = qgetenv( "EVENTS_BENCHMARK_RECURRING" ).toInt( &ok );
+
+    if ( !ok )
+        recurringPercent = 10;
+}
+
+EventsBenchmark::~EventsBenchmark() {
+    qDeleteAll( calendars );
+}
+
+EventsBenchmark::Calendar::~Calendar() {
+    delete runner; // Runner owns the store
+}
+
+const EventsBenchmark::Calendar & EventsBenchmark::calendar( int size ) {
+    if ( Calendar * existing = calendars.value( size ) )
+        return *existing;
+
+    Calendar * cal = new Calendar();
+    cal->store = new LocalIncidenceStore( 0 );
+
+    qsrand( size ); // Same calendar for every run
+
+    // Half of items are events, half are todos, dated within a year from today
+    for ( int i = 0; i < size; ++ i ) {
+        const QString summary = QString( "%1 %2 %3" ).arg( words[ qrand() % wordCount ] ).arg( words[ qrand() % wordCount ] ).arg( i );
+        const KDateTime date( QDate::currentDate().addDays( qrand() % 730 - 365 ), QTime( qrand() % 24, 0 ), KDateTime::LocalZone );
+
+        if ( i % 2 ) {
+            KCal::Todo::Ptr todo( new KCal::Todo() );
+            todo->setSummary( summary );
+            todo->setDtDue( date );
+            todo->setHasDueDate( true );
+            todo->setPercentComplete( qrand() % 2 ? 100 : 0 );
+
+            cal->store->add( todo );
+        } else {
+            KCal::Event::Ptr event( new KCal::Event() );
+            event->setSummary( summary );
+            event->setDtStart( date );
+            event->setDtEnd( date.addSecs( 3600 ) );
+
+            if ( qrand() % 100 < recurringPercent )
+                event->recurrence()->setWeekly( 1 );
+
+            cal->store->add( event );
+        }
+    }
+
+    cal->runner = new EventsRunner( cal->store, 0 ); // Loads all items right away
+
+    const QDate today = QDate::currentDate();
+
+    cal->index.insert( cal->store->items().values() );
+    cal->index.setOccurrenceWindow( IncidenceIndex::toEpoch( KDateTime( today.addDays( -occurrencePastDays ) ) ), IncidenceIndex::toEpoch( KDateTime( today.addDays( occurrenceFutureDays + 1 ) ) ) - 1, cal->store->items() );
+
+    calendars.insert( size, cal );
+
+    return *cal;
+}
+
+void EventsBenchmark::addSizeRows( const QStringList & variants ) {
+    static const int sizes[] = { 1000, 10000, 100000 };
+
+    for ( int i = 0; i < 3; ++ i )
+        foreach ( const QString & variant, variants )
+            QTest::newRow( qPrintable( QString( "%1k, %2" ).arg( sizes[i] / 1000 ).arg( variant ) ) ) << sizes[i] << variant;
+}
+
+void EventsBenchmark::benchmarkParseRange_data() {
+    QTest::addColumn<QString>( "query" );
+
+    QTest::newRow( "keyword" ) << "events tomorrow";
+    QTest::newRow( "phrase" ) << "events in 2 weeks after tomorrow";
+    QTest::newRow( "range" ) << "events from today 12:00 to tomorrow 13:00";
+}
+
+void EventsBenchmark::benchmarkParseRange() {
+    QFETCH( QString, query );
+
+    const QStringRef expression = query.midRef( query.indexOf( ' ' ) + 1 ); // Skip keyword, as runner does
+    DateTimeRange range;
+
+    QBENCHMARK {
+        range = parser.parseRange( expression );
+    }
+
+    QVERIFY( range.isValid() );
+}
+
+void EventsBenchmark::benchmarkRangeOperations() {
+    const KDateTime today( QDate::currentDate(), QTime( 0, 0 ), KDateTime::LocalZone );
+    const DateTimeRange week( today, today.addDays( 7 ) );
+
+    int included = 0;
+
+    QBENCHMARK {
+        included = 0;
+
+        for ( int i = 0; i < 100; ++ i ) {
+            const KDateTime dt = today.addSecs( i * 3 * 3600 );
+
+            if ( week.includes( dt ) )
+                ++ included;
+
+            if ( week.intersects( dt, dt.addSecs( 3600 ) ) )
+                ++ included;
+
+            DateTimeRange moved( week );
+            moved.addDays( 1, DateTimeRange::Both );
+            moved.setTime( dt.time(), DateTimeRange::Start );
+
+            IncidenceIndex::rangeStart( moved );
+            IncidenceIndex::rangeFinish( moved );
+        }
+    }
+
+    QVERIFY( included > 0 );
+}
+
+void EventsBenchmark::benchmarkTextSearch_data() {
+    QTest::addColumn<int>( "size" );
+    QTest::addColumn<QString>( "method" );
+
+    addSizeRows( QStringList() << "linear" << "trigrams" );
+}
+
+void EventsBenchmark::benchmarkTextSearch() {
+    QFETCH( int, size );
+    QFETCH( QString, method );
+
+    const IncidenceIndex & idx = calendar( size ).index;
+    const QString query = QString( "dentist 4" ).toCaseFolded();
+
+    int found = 0;
+
+    if ( method == "trigrams" ) {
+        QBENCHMARK {
+            found = idx.search( query ).size();
+        }
+    } else {
+        QBENCHMARK {
+            found = 0;
+
+            foreach ( const IncidenceRecord & record, idx.records() )
+                if ( record.summary.contains( query ) )
+                    ++ found;
+        }
+    }
+
+    QVERIFY( found > 0 );
+}
+
+void EventsBenchmark::benchmarkRangeSearch_data() {
+    QTest::addColumn<int>( "size" );
+    QTest::addColumn<QString>( "range" );
+
+    addSizeRows( QStringList() << "today" << "in 7 days" << "from today to in 1 months" );
+}
+
+void EventsBenchmark::benchmarkRangeSearch() {
+    QFETCH( int, size );
+    QFETCH( QString, range );
+
+    const IncidenceIndex & idx = calendar( size ).index;
+    const DateTimeRange parsed = parser.parseRange( range );
+    const qint64 from = IncidenceIndex::rangeStart( parsed );
+    const qint64 to = IncidenceIndex::rangeFinish( parsed );
+
+    QVERIFY( idx.coversRange( from, to ) );
+
+    int found = 0;
+
+    QBENCHMARK {
+        found = idx.searchRange( from, to ).size();
+    }
+
+    QVERIFY( found > 0 );
+}
+
+void EventsBenchmark::benchmarkQueryMatch_data() {
+    QTest::addColumn<int>( "size" );
+    QTest::addColumn<QString>( "query" );
+
+    addSizeRows( QStringList() << "complete meeting" << "comment dentist 4; note" << "events tomorrow" << "todos from today to in 1 months" );
+}
+
+void EventsBenchmark::benchmarkQueryMatch() {
+    QFETCH( int, size );
+    QFETCH( QString, query );
+
+    EventsRunner * runner = calendar( size ).runner;
+    int found = 0;
+
+    QBENCHMARK {
+        runner->dropQueryCaches(); // Measure cold selection, not refinement of previous iteration or cached range
+
+        Plasma::RunnerContext context;
+        context.setQuery( query );
+
+        runner->match( context );
+
+        found = context.matches().size();
+    }
+
+    QVERIFY( found > 0 );
+}
+
+void EventsBenchmark::testQueryAllocations_data() {
+    QTest::addColumn<QString>( "query" );
+
+    QTest::newRow( "create" ) << "event Lunch with team; tomorrow 12:00";
+    QTest::newRow( "complete" ) << "complete meeting";
+    QTest::newRow( "comment" ) << "comment dentist 4; note";
+    QTest::newRow( "show" ) << "events from today to in 1 months";
+}
+
+void EventsBenchmark::testQueryAllocations() {
+    QFETCH( QString, query );
+
+    EventsRunner * runner = calendar( 1000 ).runner;
+
+    Plasma::RunnerContext warmup; // Lazily created state, which isn't allocated per query
+    warmup.setQuery( query );
+    runner->match( warmup );
+
+    runner->dropQueryCaches();
+
+    Plasma::RunnerContext context;
+    context.setQuery( query );
+
+    const int before = allocations();
+    runner->match( context );
+    const int allocated = allocations() - before;
+
+    const int matches = context.matches().size();
+
+    QVERIFY( matches > 0 );
+    QVERIFY2( allocated <= maxQueryAllocations + matches * maxMatchAllocations, qPrintable( QString( "%1 allocations for %2 matches" ).arg( allocated ).arg( matches ) ) );
+}
+
+QTEST_KDEMAIN(EventsBenchmark, GUI)
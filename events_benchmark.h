@@ -0,0 +1,81 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTS_BENCHMARK_H
+#define EVENTS_BENCHMARK_H
+
+#include <QtTest/QtTest>
+
+#include "datetime_parser.h"
+#include "incidence_index.h"
+
+class EventsRunner;
+class LocalIncidenceStore;
+
+/**
+  Benchmarks of parsing, searching and whole runner queries over generated
+  calendars, with check that a query allocates on heap only for its matches. Percent of recurring events is taken from EVENTS_BENCHMARK_RECURRING
+  environment variable, 10 by default. Runner works over in-memory store, so
+  benchmarks run without Akonadi server. Runner queries are measured cold,
+  with its query caches dropped before every iteration.
+*/
+class EventsBenchmark: public QObject {
+    Q_OBJECT
+public:
+    EventsBenchmark();
+    ~EventsBenchmark();
+private slots:
+    void benchmarkParseRange_data();
+    void benchmarkParseRange();
+    void benchmarkRangeOperations();
+    void benchmarkTextSearch_data();
+    void benchmarkTextSearch();
+    void benchmarkRangeSearch_data();
+    void benchmarkRangeSearch();
+    void benchmarkQueryMatch_data();
+    void benchmarkQueryMatch();
+    void testQueryAllocations_data();
+    void testQueryAllocations();
+private:
+    /**
+      Runner over generated items, with separate index for measuring its operations
+    */
+    struct Calendar {
+        Calendar() : runner( 0 ), store( 0 ) {}
+        ~Calendar();
+
+        EventsRunner * runner;
+        LocalIncidenceStore * store;
+        IncidenceIndex index;
+    };
+private:
+    const Calendar & calendar( int size );
+
+    /**
+      Add rows for every calendar size and given variant
+    */
+    void addSizeRows( const QStringList & variants );
+private:
+    QMap<int, Calendar *> calendars; // Generated calendars by size
+    DateTimeParser parser;
+    int recurringPercent;
+};
+
+#endif
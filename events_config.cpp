@@ -41,10 +41,19 @@ EventsRunnerConfig::EventsRunnerConfig(QWidget* parent, const QVariantList& args
 
     connect( ui->eventCollectionCombo, SIGNAL( currentIndexChanged(int) ), this, SLOT( changed() ) );
     connect( ui->todoCollectionCombo, SIGNAL( currentIndexChanged(int) ), this, SLOT( changed() ) );
+    connect( ui->searchCollectionList, SIGNAL( itemChanged(QListWidgetItem *) ), this, SLOT( changed() ) );
 }
 
 void EventsRunnerConfig::defaults() {
     KCModule::defaults();
+
+    ui->eventCollectionCombo->setCurrentIndex( 0 );
+    ui->todoCollectionCombo->setCurrentIndex( 0 );
+
+    for ( int i = 0; i < ui->searchCollectionList->count(); ++ i ) // All collections are searched by default
+        ui->searchCollectionList->item( i )->setCheckState( Qt::Checked );
+
+    emit changed( true );
 }
 
 void EventsRunnerConfig::load() {
@@ -60,9 +69,12 @@ void EventsRunnerConfig::collectionsReceived( CollectionSelector& selector ) {
 
     Collection::Id eventCollectionId = cfg.readEntry( CONFIG_EVENT_COLLECTION, (Collection::Id)0 );
     Collection::Id todoCollectionId = cfg.readEntry( CONFIG_TODO_COLLECTION, (Collection::Id)0 );
+    QList<Collection::Id> searchCollectionIds = cfg.readEntry( CONFIG_SEARCH_COLLECTIONS, QList<Collection::Id>() );
+    bool searchAllCollections = cfg.readEntry( CONFIG_SEARCH_ALL_COLLECTIONS, searchCollectionIds.isEmpty() );
 
     ui->eventCollectionCombo->clear();
     ui->todoCollectionCombo->clear();
+    ui->searchCollectionList->clear();
 
     foreach ( const Collection & collection, selector.eventCollections ) {
         ui->eventCollectionCombo->addItem( collection.name(), collection.id() );
@@ -78,6 +90,14 @@ void EventsRunnerConfig::collectionsReceived( CollectionSelector& selector ) {
             ui->todoCollectionCombo->setCurrentIndex( ui->todoCollectionCombo->count() - 1 );
     }
 
+    foreach ( const Collection & collection, selector.calendarCollections() ) {
+        QListWidgetItem * item = new QListWidgetItem( collection.name(), ui->searchCollectionList );
+
+        item->setData( Qt::UserRole, collection.id() );
+        item->setFlags( item->flags() | Qt::ItemIsUserCheckable );
+        item->setCheckState( searchAllCollections || searchCollectionIds.contains( collection.id() ) ? Qt::Checked : Qt::Unchecked );
+    }
+
     selector.deleteLater();
 
     emit changed(false);
@@ -90,6 +110,23 @@ void EventsRunnerConfig::save() {
     cfg.writeEntry( CONFIG_EVENT_COLLECTION, ui->eventCollectionCombo->itemData( ui->eventCollectionCombo->currentIndex() ).toLongLong() );
     cfg.writeEntry( CONFIG_TODO_COLLECTION, ui->todoCollectionCombo->itemData( ui->todoCollectionCombo->currentIndex() ).toLongLong() );
 
+    QList<Collection::Id> searchCollectionIds;
+
+    for ( int i = 0; i < ui->searchCollectionList->count(); ++ i ) {
+        QListWidgetItem * item = ui->searchCollectionList->item( i );
+
+        if ( item->checkState() == Qt::Checked )
+            searchCollectionIds.append( item->data( Qt::UserRole ).toLongLong() );
+    }
+
+    const bool searchAllCollections = searchCollectionIds.size() == ui->searchCollectionList->count(); // Including ones created later
+
+    if ( searchAllCollections )
+        searchCollectionIds.clear();
+
+    cfg.writeEntry( CONFIG_SEARCH_ALL_COLLECTIONS, searchAllCollections );
+    cfg.writeEntry( CONFIG_SEARCH_COLLECTIONS, searchCollectionIds ); // Empty list now means no collections
+
     emit changed(true);
 }
 
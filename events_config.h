@@ -34,6 +34,10 @@ static const char RUNNER_NAME[] = "Events Runner";
 
 static const char CONFIG_TODO_COLLECTION[] = "todoCollection";
 static const char CONFIG_EVENT_COLLECTION[] = "eventCollection";
+static const char CONFIG_SEARCH_COLLECTIONS[] = "searchCollections";
+static const char CONFIG_SEARCH_ALL_COLLECTIONS[] = "searchAllCollections";
+static const char CONFIG_OCCURRENCE_PAST_DAYS[] = "occurrencePastDays";
+static const char CONFIG_OCCURRENCE_FUTURE_DAYS[] = "occurrenceFutureDays";
 
 class CollectionSelector;
 
@@ -0,0 +1,462 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "events_runner_test.h"
+#include "events.h"
+#include "collection_selector.h"
+#include "incidence_index_file.h"
+#include "item_cache.h"
+#include "local_incidence_store.h"
+#include "metrics_registry.h"
+
+#include <Plasma/RunnerContext>
+#include <Plasma/QueryMatch>
+
+#include <KTemporaryFile>
+
+#include <qtest_kde.h>
+
+#include <kcal/event.h>
+#include <kcal/todo.h>
+
+using namespace Akonadi;
+
+/**
+  Store which reports results of modifications only when asked
+*/
+class DeferredIncidenceStore : public LocalIncidenceStore {
+public:
+    DeferredIncidenceStore() : LocalIncidenceStore( 0 ), lastWrite( 0 ), deferFetch( false ) {}
+
+    void fetch( const QHash<Akonadi::Item::Id, int> & knownRevisions ) {
+        if ( !deferFetch )
+            LocalIncidenceStore::fetch( knownRevisions );
+    }
+
+    void fetchItem( Akonadi::Item::Id id ) {
+        if ( deferFetch )
+            fetchedItems.append( id );
+        else
+            LocalIncidenceStore::fetchItem( id );
+    }
+
+    int create( const KCal::Incidence::Ptr & incidence ) {
+        Akonadi::Item item( eventMimeType );
+        item.setPayload<KCal::Incidence::Ptr>( incidence );
+
+        lastWrite = nextWriteId();
+        emit writeSubmitted( lastWrite, item );
+        return lastWrite;
+    }
+
+    int modify( const Akonadi::Item & item ) {
+        lastWrite = nextWriteId();
+        modifiedItems.append( item );
+        emit writeSubmitted( lastWrite, item );
+        return lastWrite;
+    }
+
+    void finish( const Akonadi::Item & item, bool success ) {
+        emit writeFinished( lastWrite, item, success );
+    }
+
+    void finishFetch() {
+        LocalIncidenceStore::fetch( QHash<Akonadi::Item::Id, int>() );
+
+        foreach ( Akonadi::Item::Id id, fetchedItems )
+            LocalIncidenceStore::fetchItem( id );
+
+        fetchedItems.clear();
+    }
+
+    int lastWrite;
+    bool deferFetch; // Deliver items only on finishFetch()
+    QList<Akonadi::Item::Id> fetchedItems;
+    QList<Akonadi::Item> modifiedItems;
+};
+
+/**
+  Store which isn't ready until its collections are received, like Akonadi one at startup
+*/
+class UnreadyIncidenceStore : public LocalIncidenceStore {
+public:
+    UnreadyIncidenceStore() : LocalIncidenceStore( 0 ) {}
+
+    bool isReady() const { return false; }
+    QString source() const { return QLatin1String( "test" ); }
+};
+
+static QString cachedTitle( ItemCache & cache, Akonadi::Item::Id id ) {
+    ItemCache::SnapshotPtr snapshot = cache.snapshot();
+
+    return snapshot->index.records()[ snapshot->index.position( id ) ].title;
+}
+
+/**
+  Relevance of match for incidence with given summary, or -1 if there is no such match
+*/
+static qreal relevance( const QList<Plasma::QueryMatch> & list, const QString & summary ) {
+    foreach ( const Plasma::QueryMatch & match, list )
+        if ( match.text().contains( '"' + summary + '"' ) )
+            return match.relevance();
+
+    return -1;
+}
+
+static QList<Plasma::QueryMatch> matches( EventsRunner * runner, const QString & query ) {
+    Plasma::RunnerContext context;
+    context.setQuery( query );
+
+    runner->match( context );
+
+    return context.matches();
+}
+
+void EventsRunnerTest::init() {
+    store = new LocalIncidenceStore( 0 );
+
+    KCal::Event::Ptr event( new KCal::Event() );
+    event->setSummary( "Project meeting" );
+    event->setDtStart( KDateTime( QDate( 2009, 10, 21 ), QTime( 12, 0 ) ) );
+    store->add( event );
+
+    KCal::Todo::Ptr todo( new KCal::Todo() );
+    todo->setSummary( "Write project report" );
+    todo->setDtDue( KDateTime( QDate( 2009, 10, 22 ) ) );
+    todo->setHasDueDate( true );
+    todo->setPercentComplete( 0 );
+    store->add( todo );
+
+    runner = new EventsRunner( store, 0 ); // Takes ownership of the store
+}
+
+void EventsRunnerTest::cleanup() {
+    delete runner;
+}
+
+void EventsRunnerTest::testCreateEvent() {
+    QList<Plasma::QueryMatch> list = matches( runner, "event Lunch; 23.10.2009 13:00" );
+
+    QCOMPARE( list.size(), 1 );
+
+    runner->run( Plasma::RunnerContext(), list[0] );
+
+    QCOMPARE( store->items().size(), 3 );
+
+    list = matches( runner, "events 23.10.2009" ); // Created event is cached right away
+
+    QCOMPARE( list.size(), 1 );
+    QCOMPARE( list[0].text(), QString( "Lunch" ) );
+}
+
+void EventsRunnerTest::testCreateTodo() {
+    QList<Plasma::QueryMatch> list = matches( runner, "todo Call back; 23.10.2009" );
+
+    QCOMPARE( list.size(), 1 );
+
+    runner->run( Plasma::RunnerContext(), list[0] );
+
+    QCOMPARE( store->items().size(), 3 );
+    QCOMPARE( matches( runner, "complete call" ).size(), 1 );
+}
+
+void EventsRunnerTest::testCompleteTodo() {
+    QList<Plasma::QueryMatch> list = matches( runner, "complete report; 50" );
+
+    QCOMPARE( list.size(), 1 );
+
+    runner->run( Plasma::RunnerContext(), list[0] );
+
+    foreach ( const Item & item, store->items() )
+        if ( item.mimeType() == todoMimeType )
+            QCOMPARE( item.payload<KCal::Todo::Ptr>()->percentComplete(), 50 );
+}
+
+void EventsRunnerTest::testCommentIncidence() {
+    QCOMPARE( matches( runner, "comment project" ).size(), 0 ); // No comment given
+
+    QList<Plasma::QueryMatch> list = matches( runner, "comment meeting; Bring slides" );
+
+    QCOMPARE( list.size(), 1 );
+
+    runner->run( Plasma::RunnerContext(), list[0] );
+
+    foreach ( const Item & item, store->items() )
+        if ( item.mimeType() == eventMimeType )
+            QVERIFY( item.payload<KCal::Incidence::Ptr>()->description().endsWith( "Bring slides" ) );
+}
+
+void EventsRunnerTest::testQueuedUpdates() {
+    DeferredIncidenceStore * deferred = new DeferredIncidenceStore();
+
+    KCal::Todo::Ptr todo( new KCal::Todo() );
+    todo->setSummary( "Write project report" );
+    todo->setPercentComplete( 0 );
+    deferred->add( todo );
+
+    EventsRunner deferredRunner( deferred, 0 );
+    deferred->deferFetch = true; // Items are loaded, delay fetches for update
+
+    QList<Plasma::QueryMatch> list = matches( &deferredRunner, "complete report; 50" );
+    QCOMPARE( list.size(), 1 );
+    deferredRunner.run( Plasma::RunnerContext(), list[0] );
+
+    list = matches( &deferredRunner, "comment report; Half done" );
+    QCOMPARE( list.size(), 1 );
+    deferredRunner.run( Plasma::RunnerContext(), list[0] );
+
+    deferred->finishFetch();
+
+    QCOMPARE( deferred->modifiedItems.size(), 1 ); // Both updates in single modification
+
+    const KCal::Incidence::Ptr modified = deferred->modifiedItems[0].payload<KCal::Incidence::Ptr>();
+    QCOMPARE( static_cast<KCal::Todo *>( modified.get() )->percentComplete(), 50 );
+    QVERIFY( modified->description().endsWith( "Half done" ) );
+}
+
+void EventsRunnerTest::testShowEvents() {
+    QCOMPARE( matches( runner, "events 21.10.2009" ).size(), 1 );
+    QCOMPARE( matches( runner, "todos 22.10.2009" ).size(), 1 );
+    QCOMPARE( matches( runner, "events 25.10.2009" ).size(), 0 );
+}
+
+void EventsRunnerTest::testKeywordAliases() {
+    QCOMPARE( matches( runner, "ev Lunch; 23.10.2009 13:00" ).size(), 1 );
+    QCOMPARE( matches( runner, "td Call back; 23.10.2009" ).size(), 1 );
+    QCOMPARE( matches( runner, "Events 21.10.2009" ).size(), 1 );
+    QCOMPARE( matches( runner, "evening 21.10.2009" ).size(), 0 ); // Not a keyword followed by date
+}
+
+void EventsRunnerTest::testRanking() {
+    LocalIncidenceStore * local = new LocalIncidenceStore( 0 );
+    const KDateTime date( QDate( 2009, 10, 21 ), QTime( 12, 0 ) );
+
+    const char * const eventSummaries[] = { "Dentist appointment", "Visit dentist", "Orthodentistry" };
+
+    for ( int i = 0; i < 3; ++ i ) {
+        KCal::Event::Ptr event( new KCal::Event() );
+        event->setSummary( eventSummaries[i] );
+        event->setDtStart( date );
+        local->add( event );
+    }
+
+    for ( int percent = 0; percent <= 100; percent += 100 ) {
+        KCal::Todo::Ptr todo( new KCal::Todo() );
+        todo->setSummary( QString( "Pay bills %1" ).arg( percent ) );
+        todo->setPercentComplete( percent );
+        local->add( todo );
+    }
+
+    for ( int i = 0; i < 15; ++ i ) {
+        KCal::Todo::Ptr todo( new KCal::Todo() );
+        todo->setSummary( QString( "Call client %1" ).arg( i ) );
+        local->add( todo );
+    }
+
+    EventsRunner localRunner( local, 0 );
+
+    QList<Plasma::QueryMatch> list = matches( &localRunner, "comment dentist; note" );
+    QCOMPARE( list.size(), 3 );
+    QVERIFY( relevance( list, "Dentist appointment" ) > relevance( list, "Visit dentist" ) ); // Prefix over word
+    QVERIFY( relevance( list, "Visit dentist" ) > relevance( list, "Orthodentistry" ) ); // Word over infix
+
+    list = matches( &localRunner, "comment pay bills; note" );
+    QCOMPARE( list.size(), 2 );
+    QVERIFY( relevance( list, "Pay bills 0" ) > relevance( list, "Pay bills 100" ) ); // Incomplete first
+
+    list = matches( &localRunner, "comment call client; note" );
+    QCOMPARE( list.size(), 10 ); // Only best matches are shown
+}
+
+void EventsRunnerTest::testCancelledQuery() {
+    Plasma::RunnerContext context;
+    context.setQuery( "complete report" );
+
+    Plasma::RunnerContext query( context ); // Shares context, which is invalidated on reset
+    context.reset();
+    QVERIFY( !query.isValid() );
+
+    const int cancelled = runner->cancelledQueryCount();
+    const int skipped = runner->skippedScanItemCount();
+
+    runner->match( query );
+
+    QVERIFY( query.matches().isEmpty() );
+    QCOMPARE( runner->cancelledQueryCount(), cancelled + 1 );
+    QVERIFY( runner->skippedScanItemCount() > skipped );
+
+    QCOMPARE( matches( runner, "complete report" ).size(), 1 ); // Valid query isn't affected
+    QCOMPARE( runner->cancelledQueryCount(), cancelled + 1 );
+}
+
+void EventsRunnerTest::testSavedIndex() {
+    KCal::Event::Ptr event( new KCal::Event() );
+    event->setSummary( "Weekly review" );
+    event->setDtStart( KDateTime( QDate::currentDate(), QTime( 10, 0 ) ) );
+    event->recurrence()->setWeekly( 1 );
+    store->add( event );
+
+    IncidenceIndex index;
+    index.setOccurrenceWindow( IncidenceIndex::toEpoch( KDateTime( QDate::currentDate() ) ), IncidenceIndex::toEpoch( KDateTime( QDate::currentDate().addDays( 30 ) ) ), store->items() );
+    index.insert( store->items().values() );
+
+    KTemporaryFile file;
+    QVERIFY( file.open() );
+    QVERIFY( IncidenceIndexFile::save( file.fileName(), "test", index ) );
+
+    IncidenceIndex restored;
+    restored.setOccurrenceWindow( IncidenceIndex::toEpoch( KDateTime( QDate::currentDate() ) ), IncidenceIndex::toEpoch( KDateTime( QDate::currentDate().addDays( 30 ) ) ), QHash<Akonadi::Item::Id, Akonadi::Item>() );
+
+    QVERIFY( !IncidenceIndexFile::load( file.fileName(), "other", restored ) );
+    QVERIFY( IncidenceIndexFile::load( file.fileName(), "test", restored ) );
+    QCOMPARE( restored.size(), 3 );
+
+    foreach ( const IncidenceRecord & record, index.records() ) {
+        const IncidenceRecord & copy = restored.records()[ restored.position( record.id ) ];
+
+        QCOMPARE( copy.revision, record.revision );
+        QCOMPARE( copy.title, record.title );
+        QCOMPARE( copy.summary, record.summary );
+        QCOMPARE( copy.start, record.start );
+        QCOMPARE( copy.flags, record.flags );
+        QCOMPARE( restored.occurrences( record.id ), index.occurrences( record.id ) );
+    }
+
+    QCOMPARE( restored.search( "review" ).size(), 1 );
+    QCOMPARE( restored.searchRange( IncidenceIndex::toEpoch( KDateTime( QDate::currentDate().addDays( 7 ) ) ), IncidenceIndex::toEpoch( KDateTime( QDate::currentDate().addDays( 8 ) ) ) ).size(), 1 );
+}
+
+void EventsRunnerTest::testDamagedIndex() {
+    IncidenceIndex index;
+    index.insert( store->items().values() );
+
+    KTemporaryFile file;
+    QVERIFY( file.open() );
+    QVERIFY( IncidenceIndexFile::save( file.fileName(), "test", index ) );
+
+    QVERIFY( QFile::resize( file.fileName(), QFileInfo( file.fileName() ).size() - 4 ) ); // Truncated, file was replaced on save
+    QVERIFY( !IncidenceIndexFile::load( file.fileName(), "test", index ) );
+    QVERIFY( !QFile::exists( file.fileName() ) );
+
+    QFile damaged( file.fileName() );
+    QVERIFY( damaged.open( QIODevice::WriteOnly ) );
+
+    QDataStream out( &damaged );
+    out.setVersion( QDataStream::Qt_4_6 );
+    out << quint32( 0x45564958 ) << quint32( 1 ) << QString( "test" ) << qint32( 0x7fffffff ); // Count far beyond file size
+    damaged.close();
+
+    IncidenceIndex restored;
+    QVERIFY( !IncidenceIndexFile::load( file.fileName(), "test", restored ) );
+    QCOMPARE( restored.size(), 0 );
+    QVERIFY( !QFile::exists( file.fileName() ) );
+}
+
+void EventsRunnerTest::testRestoreBeforeReady() {
+    IncidenceIndex index;
+    index.insert( store->items().values() );
+
+    KTemporaryFile file;
+    QVERIFY( file.open() );
+    QVERIFY( IncidenceIndexFile::save( file.fileName(), "test", index ) );
+
+    EventsRunner * restored = new EventsRunner( new UnreadyIncidenceStore(), 0, file.fileName() );
+    QList<Plasma::QueryMatch> list = matches( restored, "complete report" );
+    delete restored;
+
+    QVERIFY( relevance( list, "Write project report" ) > 0 ); // Answered from saved items
+    QCOMPARE( list.size(), 2 ); // Along with loading hint
+}
+
+void EventsRunnerTest::testOptimisticWrites() {
+    DeferredIncidenceStore deferred;
+
+    KCal::Todo::Ptr todo( new KCal::Todo() );
+    todo->setSummary( "Old summary" );
+    const Item item = deferred.add( todo );
+
+    MetricsRegistry metrics;
+    ItemCache cache( &deferred, metrics, 0 );
+    QVERIFY( cache.isLoaded() );
+
+    Item modified( item );
+    modified.setPayload<KCal::Incidence::Ptr>( KCal::Incidence::Ptr( todo->clone() ) );
+    modified.payload<KCal::Incidence::Ptr>()->setSummary( "New summary" );
+
+    deferred.modify( modified );
+    QCOMPARE( cachedTitle( cache, item.id() ), QString( "New summary" ) ); // Applied before confirmation
+
+    deferred.finish( modified, false );
+    QCOMPARE( cachedTitle( cache, item.id() ), QString( "Old summary" ) ); // Rolled back
+
+    deferred.modify( modified );
+    modified.setRevision( item.revision() + 1 );
+    deferred.finish( modified, true );
+    QCOMPARE( cachedTitle( cache, item.id() ), QString( "New summary" ) );
+    QCOMPARE( cache.snapshot()->items.value( item.id() ).revision(), item.revision() + 1 );
+}
+
+void EventsRunnerTest::testWriteDuringFetch() {
+    DeferredIncidenceStore deferred;
+    deferred.deferFetch = true;
+
+    KCal::Todo::Ptr todo( new KCal::Todo() );
+    todo->setSummary( "Stored todo" );
+    deferred.add( todo );
+
+    MetricsRegistry metrics;
+    ItemCache cache( &deferred, metrics, 0 );
+    QVERIFY( !cache.isLoaded() );
+
+    KCal::Event::Ptr event( new KCal::Event() );
+    event->setSummary( "Created event" );
+    event->setDtStart( KDateTime::currentLocalDateTime() );
+
+    const int writeId = deferred.create( event );
+    deferred.finishFetch();
+
+    QVERIFY( cache.isLoaded() );
+    QCOMPARE( cachedTitle( cache, -writeId ), QString( "Created event" ) ); // Still waiting for the store
+}
+
+void EventsRunnerTest::testCacheMetrics() {
+    LocalIncidenceStore local;
+
+    KCal::Event::Ptr event( new KCal::Event() );
+    event->setSummary( "Meeting" );
+    event->setDtStart( KDateTime::currentLocalDateTime() );
+    local.add( event );
+
+    MetricsRegistry metrics;
+    ItemCache cache( &local, metrics, 0 );
+    QVERIFY( cache.isLoaded() );
+
+    const QString report = metrics.report();
+    QVERIFY( report.contains( "cache.items\t1\n" ) );
+    QVERIFY( report.contains( "fetch.runs\t1\n" ) );
+    QVERIFY( report.contains( "fetch.items\t1\n" ) );
+    QVERIFY( !report.contains( "cache.refreshed\tnever" ) );
+
+    metrics.reset();
+    QVERIFY( metrics.report().contains( "fetch.runs\t0\n" ) );
+    QVERIFY( metrics.report().contains( "cache.items\t1\n" ) ); // Gauges are kept
+}
+
+QTEST_KDEMAIN( EventsRunnerTest, GUI )
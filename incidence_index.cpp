@@ -0,0 +1,528 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incidence_index.h"
+
+#include <kcal/event.h>
+#include <kcal/todo.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+static const qint64 dayLength = 24 * 3600 - 1; // Last second of the day relative to its start
+
+/**
+  Check if point with given span (zero or whole day) is at least partially inside range
+*/
+static inline bool includes( qint64 point, qint64 span, qint64 from, qint64 to ) {
+    return point + span >= from && point <= to;
+}
+
+void IncidenceIndex::insert( const Akonadi::Item & item ) {
+    insertRecord( item );
+}
+
+void IncidenceIndex::insert( const Akonadi::Item::List & items ) {
+    dateEntriesSorted = false; // Append date entries and sort them once at the end
+
+    foreach ( const Akonadi::Item & item, items )
+        insertRecord( item );
+
+    qSort( dateEntries );
+    dateEntriesSorted = true;
+}
+
+void IncidenceIndex::insert( const QVector<IncidenceRecord> & records, const QHash<Akonadi::Item::Id, QVector<qint64> > & occurrences ) {
+    dateEntriesSorted = false;
+
+    foreach ( const IncidenceRecord & record, records ) {
+        QVector<qint64> times;
+
+        foreach ( qint64 time, occurrences.value( record.id ) )
+            if ( windowStart <= time && time <= windowEnd )
+                times.append( time );
+
+        insertRecord( record, times );
+    }
+
+    qSort( dateEntries );
+    dateEntriesSorted = true;
+}
+
+void IncidenceIndex::insertRecord( const Akonadi::Item & item ) {
+    QHash<Akonadi::Item::Id, int>::const_iterator it = positions.constFind( item.id() );
+
+    if ( it != positions.constEnd() && recordList[ it.value() ].revision == item.revision() )
+        return; // Record is up to date
+
+    IncidenceRecord record;
+
+    if ( !extractRecord( item, record ) ) {
+        remove( item.id() );
+        return;
+    }
+
+    insertRecord( record, ( record.flags & IncidenceRecord::Recurs ) ? expandOccurrences( item ) : QVector<qint64>() );
+}
+
+void IncidenceIndex::insertRecord( const IncidenceRecord & record, const QVector<qint64> & times ) {
+    QHash<Akonadi::Item::Id, int>::const_iterator it = positions.constFind( record.id );
+
+    if ( it != positions.constEnd() ) {
+        const int pos = it.value();
+
+        unindexRecord( pos );
+        occurrenceTimes.remove( record.id );
+        recordList[ pos ] = record;
+    } else {
+        positions.insert( record.id, recordList.size() );
+        recordList.append( record );
+    }
+
+    if ( record.flags & IncidenceRecord::Recurs )
+        occurrenceTimes.insert( record.id, times );
+
+    indexRecord( positions.value( record.id ) ); // New record is appended to the end of postings, as its position is the greatest
+}
+
+void IncidenceIndex::remove( Akonadi::Item::Id id ) {
+    QHash<Akonadi::Item::Id, int>::iterator it = positions.find( id );
+
+    if ( it == positions.end() )
+        return;
+
+    const int pos = it.value();
+    const int last = recordList.size() - 1;
+
+    positions.erase( it );
+    unindexRecord( pos );
+    occurrenceTimes.remove( id );
+
+    if ( pos != last ) { // Move last record into the hole to keep array dense
+        unindexRecord( last );
+        recordList[ pos ] = recordList[ last ];
+        positions[ recordList[ pos ].id ] = pos;
+        indexRecord( pos );
+    }
+
+    recordList.resize( last );
+}
+
+void IncidenceIndex::clear() {
+    recordList.clear();
+    positions.clear();
+    postings.clear();
+    dateEntries.clear();
+    recurringIds.clear();
+    occurrenceTimes.clear();
+}
+
+void IncidenceIndex::setOccurrenceWindow( qint64 from, qint64 to, const QHash<Akonadi::Item::Id, Akonadi::Item> & items ) {
+    windowStart = from;
+    windowEnd = to;
+
+    // Drop all occurrences at once instead of removing them one by one
+    QVector<DateEntry> entries;
+
+    foreach ( const DateEntry & entry, dateEntries )
+        if ( !( recordList[ entry.pos ].flags & IncidenceRecord::Recurs ) )
+            entries.append( entry );
+
+    foreach ( Akonadi::Item::Id id, recurringIds ) {
+        const QVector<qint64> times = expandOccurrences( items.value( id ) );
+        DateEntry entry = { 0, positions.value( id ) };
+
+        foreach ( qint64 time, times ) {
+            entry.key = time;
+            entries.append( entry );
+        }
+
+        occurrenceTimes.insert( id, times );
+    }
+
+    qSort( entries );
+    dateEntries = entries;
+}
+
+QVector<qint64> IncidenceIndex::expandOccurrences( const Akonadi::Item & item ) const {
+    QVector<qint64> result;
+
+    if ( windowStart > windowEnd )
+        return result;
+
+    if ( !item.hasPayload<KCal::Incidence::Ptr>() ) { // Restored record, keep what is known about it
+        foreach ( qint64 time, occurrenceTimes.value( item.id() ) )
+            if ( windowStart <= time && time <= windowEnd )
+                result.append( time );
+
+        return result;
+    }
+
+    KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
+
+    foreach ( const KDateTime & dt, incidence->recurrence()->timesInInterval( fromEpoch( windowStart ), fromEpoch( windowEnd ) ) )
+        result.append( toEpoch( dt ) );
+
+    qSort( result );
+
+    return result;
+}
+
+qint64 IncidenceIndex::approximateSize() const {
+    qint64 size = recordList.capacity() * sizeof( IncidenceRecord ) + dateEntries.capacity() * sizeof( DateEntry );
+
+    foreach ( const IncidenceRecord & record, recordList )
+        size += ( record.summary.capacity() + record.title.capacity() ) * sizeof( QChar );
+
+    for ( QHash<Trigram, QVector<int> >::const_iterator it = postings.constBegin(); it != postings.constEnd(); ++ it )
+        size += sizeof( Trigram ) + sizeof( QVector<int> ) + it.value().capacity() * sizeof( int );
+
+    foreach ( const QVector<qint64> & times, occurrenceTimes )
+        size += times.capacity() * sizeof( qint64 );
+
+    return size + positions.size() * ( sizeof( Akonadi::Item::Id ) + sizeof( int ) );
+}
+
+QVector<int> IncidenceIndex::search( const QString & foldedQuery ) const {
+    QVector<int> result;
+    const QVector<Trigram> queryTrigrams = trigrams( foldedQuery );
+
+    if ( queryTrigrams.isEmpty() ) { // Too short query - check all records
+        for ( int pos = 0; pos < recordList.size(); ++ pos )
+            if ( recordList[ pos ].summary.contains( foldedQuery ) )
+                result.append( pos );
+
+        return result;
+    }
+
+    // Collect posting lists, starting intersection from the shortest one
+    QVector< const QVector<int> * > lists;
+
+    foreach ( Trigram trigram, queryTrigrams ) {
+        QHash<Trigram, QVector<int> >::const_iterator it = postings.constFind( trigram );
+
+        if ( it == postings.constEnd() ) // No summary contains this trigram
+            return result;
+
+        const QVector<int> * list = &it.value();
+        int i = lists.size();
+
+        lists.append( list );
+
+        while ( i > 0 && lists[ i - 1 ]->size() > list->size() ) { // Keep lists ordered by size
+            lists[ i ] = lists[ i - 1 ];
+            -- i;
+        }
+
+        lists[ i ] = list;
+    }
+
+    QVector<int> candidates = *lists.first();
+
+    for ( int i = 1; i < lists.size() && !candidates.isEmpty(); ++ i ) {
+        const QVector<int> & list = *lists[ i ];
+        QVector<int> intersection;
+
+        foreach ( int pos, candidates )
+            if ( qBinaryFind( list.constBegin(), list.constEnd(), pos ) != list.constEnd() )
+                intersection.append( pos );
+
+        candidates = intersection;
+    }
+
+    // Trigrams may occur in other order, so check candidates precisely
+    foreach ( int pos, candidates )
+        if ( recordList[ pos ].summary.contains( foldedQuery ) )
+            result.append( pos );
+
+    return result;
+}
+
+QVector<int> IncidenceIndex::refine( const QVector<int> & candidates, const QString & foldedQuery ) const {
+    QVector<int> result;
+
+    foreach ( int pos, candidates )
+        if ( recordList[ pos ].summary.contains( foldedQuery ) )
+            result.append( pos );
+
+    return result;
+}
+
+QVector<int> IncidenceIndex::searchRange( qint64 from, qint64 to ) const {
+    QVector<int> result;
+    QSet<int> foundRecurring; // Recurring events may have many occurrences in range
+
+    if ( from > to )
+        return result;
+
+    // Whole-day dates start before range, but may still overlap it
+    const DateEntry lower = { from - dayLength, -1 };
+
+    for ( QVector<DateEntry>::const_iterator it = qLowerBound( dateEntries.constBegin(), dateEntries.constEnd(), lower ); it != dateEntries.constEnd() && it->key <= to; ++ it ) {
+        const IncidenceRecord & record = recordList[ it->pos ];
+
+        if ( record.flags & IncidenceRecord::Recurs ) { // Entry is one of occurrences
+            const qint64 span = ( record.flags & IncidenceRecord::AllDay ) ? dayLength : 0;
+
+            if ( includes( it->key, span, from, to ) && !foundRecurring.contains( it->pos ) ) {
+                foundRecurring.insert( it->pos );
+                result.append( it->pos );
+            }
+        } else if ( matches( record, from, to ) ) {
+            result.append( it->pos );
+        }
+    }
+
+    return result;
+}
+
+bool IncidenceIndex::occurrences( Akonadi::Item::Id id, qint64 from, qint64 to, QVector<qint64> & result ) const {
+    if ( !coversRange( from, to ) )
+        return false;
+
+    const QVector<qint64> times = occurrenceTimes.value( id );
+
+    for ( QVector<qint64>::const_iterator it = qLowerBound( times.constBegin(), times.constEnd(), from ); it != times.constEnd() && *it <= to; ++ it )
+        result.append( *it );
+
+    return true;
+}
+
+QVector<IncidenceIndex::Trigram> IncidenceIndex::trigrams( const QString & s ) {
+    QVector<Trigram> result;
+
+    if ( s.length() < 3 )
+        return result;
+
+    result.reserve( s.length() - 2 );
+
+    for ( int i = 0; i + 2 < s.length(); ++ i )
+        result.append( ( Trigram( s[i].unicode() ) << 32 ) | ( Trigram( s[i + 1].unicode() ) << 16 ) | Trigram( s[i + 2].unicode() ) );
+
+    qSort( result );
+
+    QVector<Trigram>::iterator last = std::unique( result.begin(), result.end() );
+    result.resize( last - result.begin() );
+
+    return result;
+}
+
+bool IncidenceIndex::dateKey( const IncidenceRecord & record, qint64 & key ) {
+    if ( record.kind == IncidenceRecord::Event && !( record.flags & IncidenceRecord::Recurs ) ) {
+        key = record.start;
+        return true;
+    }
+
+    if ( record.kind == IncidenceRecord::Todo && ( record.flags & IncidenceRecord::HasStart ) ) {
+        key = record.start;
+        return true;
+    }
+
+    if ( record.kind == IncidenceRecord::Todo && ( record.flags & IncidenceRecord::HasDue ) ) {
+        key = record.due;
+        return true;
+    }
+
+    return false; // Recurring events are expanded separately, other incidences aren't searched by date
+}
+
+void IncidenceIndex::indexRecord( int pos ) {
+    const IncidenceRecord & record = recordList[ pos ];
+
+    foreach ( Trigram trigram, trigrams( record.summary ) ) {
+        QVector<int> & list = postings[ trigram ];
+
+        if ( list.isEmpty() || list.last() < pos )
+            list.append( pos );
+        else
+            list.insert( qLowerBound( list.begin(), list.end(), pos ), pos );
+    }
+
+    DateEntry entry = { 0, pos };
+
+    if ( dateKey( record, entry.key ) )
+        addDateEntry( entry );
+
+    if ( record.flags & IncidenceRecord::Recurs ) {
+        recurringIds.insert( record.id );
+
+        foreach ( qint64 time, occurrenceTimes.value( record.id ) ) {
+            entry.key = time;
+            addDateEntry( entry );
+        }
+    }
+}
+
+void IncidenceIndex::unindexRecord( int pos ) {
+    const IncidenceRecord & record = recordList[ pos ];
+
+    foreach ( Trigram trigram, trigrams( record.summary ) ) {
+        QHash<Trigram, QVector<int> >::iterator it = postings.find( trigram );
+
+        if ( it == postings.end() )
+            continue;
+
+        QVector<int> & list = it.value();
+        QVector<int>::iterator entry = qBinaryFind( list.begin(), list.end(), pos );
+
+        if ( entry != list.end() )
+            list.erase( entry );
+
+        if ( list.isEmpty() )
+            postings.erase( it );
+    }
+
+    DateEntry entry = { 0, pos };
+
+    if ( dateKey( record, entry.key ) )
+        removeDateEntry( entry );
+
+    if ( record.flags & IncidenceRecord::Recurs ) {
+        recurringIds.remove( record.id );
+
+        foreach ( qint64 time, occurrenceTimes.value( record.id ) ) {
+            entry.key = time;
+            removeDateEntry( entry );
+        }
+    }
+}
+
+void IncidenceIndex::addDateEntry( const DateEntry & entry ) {
+    if ( dateEntriesSorted )
+        dateEntries.insert( qLowerBound( dateEntries.begin(), dateEntries.end(), entry ), entry );
+    else
+        dateEntries.append( entry );
+}
+
+void IncidenceIndex::removeDateEntry( const DateEntry & entry ) {
+    QVector<DateEntry>::iterator it = dateEntries.end();
+
+    if ( dateEntriesSorted ) {
+        it = qBinaryFind( dateEntries.begin(), dateEntries.end(), entry );
+    } else { // Bulk insert in progress, entries aren't sorted yet
+        for ( it = dateEntries.begin(); it != dateEntries.end(); ++ it )
+            if ( it->pos == entry.pos && it->key == entry.key )
+                break;
+    }
+
+    if ( it != dateEntries.end() )
+        dateEntries.erase( it );
+}
+
+bool IncidenceIndex::extractRecord( const Akonadi::Item & item, IncidenceRecord & record ) {
+    if ( !item.hasPayload<KCal::Incidence::Ptr>() )
+        return false;
+
+    KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
+
+    if ( !incidence )
+        return false;
+
+    record.id = item.id();
+    record.revision = item.revision();
+    record.title = incidence->summary();
+    record.summary = record.title.toCaseFolded();
+    record.start = record.end = record.due = 0;
+    record.flags = incidence->allDay() ? IncidenceRecord::AllDay : 0;
+    record.percentComplete = 0;
+
+    if ( KCal::Todo * todo = dynamic_cast<KCal::Todo *>( incidence.get() ) ) {
+        record.kind = IncidenceRecord::Todo;
+        record.percentComplete = todo->percentComplete();
+
+        if ( todo->hasStartDate() ) {
+            record.start = toEpoch( todo->dtStart() );
+            record.flags |= IncidenceRecord::HasStart;
+        }
+
+        if ( todo->hasDueDate() ) {
+            record.due = toEpoch( todo->dtDue() );
+            record.flags |= IncidenceRecord::HasDue;
+        }
+    } else if ( KCal::Event * event = dynamic_cast<KCal::Event *>( incidence.get() ) ) {
+        record.kind = IncidenceRecord::Event;
+        record.start = toEpoch( event->dtStart() );
+        record.flags |= IncidenceRecord::HasStart;
+
+        if ( event->hasEndDate() ) {
+            record.end = toEpoch( event->dtEnd() );
+            record.flags |= IncidenceRecord::HasEnd;
+        }
+
+        if ( event->recurs() )
+            record.flags |= IncidenceRecord::Recurs;
+    } else {
+        record.kind = IncidenceRecord::Other;
+        record.start = toEpoch( incidence->dtStart() );
+        record.end = toEpoch( incidence->dtEnd() );
+        record.flags |= IncidenceRecord::HasStart | IncidenceRecord::HasEnd;
+    }
+
+    return true;
+}
+
+bool IncidenceIndex::matches( const IncidenceRecord & record, qint64 from, qint64 to ) {
+    const qint64 span = ( record.flags & IncidenceRecord::AllDay ) ? dayLength : 0;
+
+    if ( record.kind == IncidenceRecord::Todo ) {
+        if ( !( record.flags & ( IncidenceRecord::HasStart | IncidenceRecord::HasDue ) ) )
+            return false;
+
+        if ( ( record.flags & IncidenceRecord::HasStart ) && !includes( record.start, span, from, to ) )
+            return false;
+
+        if ( ( record.flags & IncidenceRecord::HasDue ) && !includes( record.due, span, from, to ) )
+            return false;
+
+        return true;
+    } else if ( record.kind == IncidenceRecord::Event ) {
+        return includes( record.start, span, from, to );
+    } else {
+        return record.end + span >= from && record.start <= to;
+    }
+}
+
+qint64 IncidenceIndex::rangeStart( const DateTimeRange & range ) {
+    return toEpoch( range.start );
+}
+
+qint64 IncidenceIndex::rangeFinish( const DateTimeRange & range ) {
+    return toEpoch( range.finish ) + ( range.finish.isDateOnly() ? dayLength : 0 );
+}
+
+static const KDateTime & epoch() {
+    static const KDateTime epoch( QDate( 1970, 1, 1 ), QTime( 0, 0 ), KDateTime::UTC );
+
+    return epoch;
+}
+
+qint64 IncidenceIndex::toEpoch( const KDateTime & dt ) {
+    if ( dt.isDateOnly() ) // Date-only values start at the beginning of the day
+        return epoch().secsTo_long( KDateTime( dt.date(), QTime( 0, 0 ), dt.timeSpec() ) );
+
+    return epoch().secsTo_long( dt );
+}
+
+KDateTime IncidenceIndex::fromEpoch( qint64 secs ) {
+    return epoch().addSecs( secs );
+}
@@ -0,0 +1,233 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCIDENCE_INDEX_H
+#define INCIDENCE_INDEX_H
+
+#include "datetime_range.h"
+
+#include <Akonadi/Item>
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+/**
+  Search record of single incidence, extracted from its payload once per item revision
+*/
+class IncidenceRecord {
+public:
+    enum Kind {
+        Event = 1,
+        Todo = 2,
+        Other = 4
+    };
+
+    enum Flag {
+        HasStart = 1,
+        HasEnd = 2,
+        HasDue = 4,
+        AllDay = 8, // Dates span whole days
+        Recurs = 16 // Set only for events, as only their recurrences are expanded
+    };
+
+public:
+    Akonadi::Item::Id id;
+    int revision;
+
+    qint64 start, end, due; // Seconds since epoch in UTC, valid only if corresponding flag is set
+
+    QString summary; // Case-folded
+    QString title; // Summary as entered, for displaying
+
+    quint8 kind;
+    quint8 flags;
+    qint8 percentComplete;
+};
+
+Q_DECLARE_TYPEINFO( IncidenceRecord, Q_MOVABLE_TYPE );
+
+/**
+  Flat array of incidence search records, maintained incrementally as items change.
+
+  Summaries are additionally indexed by trigrams: for each trigram index keeps
+  sorted list of positions of records containing it. Dated events and todos
+  are indexed by the date, which must fall into range for them to match.
+  Recurring events are expanded over rolling occurrence window and indexed
+  by each of their occurrences.
+*/
+class IncidenceIndex {
+public:
+    IncidenceIndex() : dateEntriesSorted( true ), windowStart( 1 ), windowEnd( 0 ) {}
+
+    /**
+      Add or update record of given item. Record is rebuilt only if item revision changed
+    */
+    void insert( const Akonadi::Item & item );
+
+    /**
+      Add or update records of many items at once, sorting date index only once
+    */
+    void insert( const Akonadi::Item::List & items );
+
+    /**
+      Add records restored from persisted index, with occurrences of their recurring
+      events. Occurrences outside of current window are dropped
+    */
+    void insert( const QVector<IncidenceRecord> & records, const QHash<Akonadi::Item::Id, QVector<qint64> > & occurrences );
+
+    void remove( Akonadi::Item::Id id );
+
+    void clear();
+
+    /**
+      Set epoch range in which recurring events are expanded and re-expand
+      them using given items
+    */
+    void setOccurrenceWindow( qint64 from, qint64 to, const QHash<Akonadi::Item::Id, Akonadi::Item> & items );
+
+    /**
+      Check if occurrences of recurring events in given epoch range are indexed
+    */
+    bool coversRange( qint64 from, qint64 to ) const { return windowStart <= from && to <= windowEnd; }
+
+    const QVector<IncidenceRecord> & records() const { return recordList; }
+
+    int size() const { return recordList.size(); }
+
+    /**
+      Approximate memory used by the index in bytes
+    */
+    qint64 approximateSize() const;
+
+    /**
+      Position of item record, or -1 if item isn't indexed
+    */
+    int position( Akonadi::Item::Id id ) const { return positions.value( id, -1 ); }
+
+    /**
+      Find positions of records which summaries contain given case-folded text.
+      Queries of three or more characters are answered using trigram index
+    */
+    QVector<int> search( const QString & foldedQuery ) const;
+
+    /**
+      Filter result of previous search by more specific query, which contains
+      previous one. Costs O(previous hits)
+    */
+    QVector<int> refine( const QVector<int> & candidates, const QString & foldedQuery ) const;
+
+    /**
+      Find positions of records which fall into given epoch range, in chronological
+      order. Recurring events are found only in part of range covered by occurrence
+      window. Costs O(log n + k)
+    */
+    QVector<int> searchRange( qint64 from, qint64 to ) const;
+
+    /**
+      Indexed occurrences of recurring event in given epoch range, returns false
+      if range isn't covered by occurrence window
+    */
+    bool occurrences( Akonadi::Item::Id id, qint64 from, qint64 to, QVector<qint64> & result ) const;
+
+    /**
+      All indexed occurrences of recurring event in current window
+    */
+    QVector<qint64> occurrences( Akonadi::Item::Id id ) const { return occurrenceTimes.value( id ); }
+
+    /**
+      Items of recurring events, for expanding them outside occurrence window
+    */
+    const QSet<Akonadi::Item::Id> & recurringItems() const { return recurringIds; }
+
+    /**
+      Check if non-recurring incidence record falls into given epoch range
+    */
+    static bool matches( const IncidenceRecord & record, qint64 from, qint64 to );
+
+    /**
+      Epoch range covered by given datetime range, date-only ends span whole days
+    */
+    static qint64 rangeStart( const DateTimeRange & range );
+    static qint64 rangeFinish( const DateTimeRange & range );
+
+    static qint64 toEpoch( const KDateTime & dt );
+    static KDateTime fromEpoch( qint64 secs );
+
+private:
+
+    typedef quint64 Trigram; // Three UTF-16 code units
+
+    struct DateEntry {
+        qint64 key; // Date which should be included in range for record to match
+        int pos;
+
+        bool operator<( const DateEntry & other ) const {
+            return key < other.key || ( key == other.key && pos < other.pos );
+        }
+    };
+
+private:
+
+    static bool extractRecord( const Akonadi::Item & item, IncidenceRecord & record );
+
+    /**
+      Distinct trigrams of given string in ascending order
+    */
+    static QVector<Trigram> trigrams( const QString & s );
+
+    /**
+      Date by which record is indexed, returns false if record isn't indexed by date
+    */
+    static bool dateKey( const IncidenceRecord & record, qint64 & key );
+
+    void insertRecord( const Akonadi::Item & item );
+    void insertRecord( const IncidenceRecord & record, const QVector<qint64> & times );
+
+    /**
+      Expand recurring event occurrences in current window. Items without payload
+      keep their previously indexed occurrences, which are in the window
+    */
+    QVector<qint64> expandOccurrences( const Akonadi::Item & item ) const;
+
+    void addDateEntry( const DateEntry & entry );
+    void removeDateEntry( const DateEntry & entry );
+
+    /**
+      Add or remove record at given position to or from trigram and date indexes
+    */
+    void indexRecord( int pos );
+    void unindexRecord( int pos );
+
+private:
+
+    QVector<IncidenceRecord> recordList;
+    QHash<Akonadi::Item::Id, int> positions; // Record positions in list by item id
+    QHash<Trigram, QVector<int> > postings; // Sorted record positions by summary trigram
+
+    QVector<DateEntry> dateEntries; // Sorted by key unless bulk insert is in progress
+    bool dateEntriesSorted;
+
+    QSet<Akonadi::Item::Id> recurringIds;
+    QHash<Akonadi::Item::Id, QVector<qint64> > occurrenceTimes; // Sorted occurrences of recurring events in window
+    qint64 windowStart, windowEnd;
+};
+
+#endif
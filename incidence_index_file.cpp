@@ -0,0 +1,211 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incidence_index_file.h"
+
+#include <KDebug>
+#include <KSaveFile>
+
+#include <QDataStream>
+#include <QFile>
+
+static const quint32 fileMagic = 0x45564958; // "EVIX"
+static const quint32 fileVersion = 1; // Increment on any format or record semantics change
+
+// Id, revision, three dates, kind, flags, percent and length of title
+static const qint64 minimumRecordSize = 8 + 4 + 3 * 8 + 1 + 1 + 1 + 4;
+
+/**
+  Read occurrences saved as QVector, checking their count before allocating
+*/
+static bool readOccurrences( QDataStream & in, QVector<qint64> & times ) {
+    quint32 count;
+    in >> count;
+
+    if ( in.status() != QDataStream::Ok || count > quint64( in.device()->bytesAvailable() ) / sizeof( qint64 ) ) {
+        in.setStatus( QDataStream::ReadCorruptData );
+        return false;
+    }
+
+    times.resize( count );
+
+    for ( quint32 i = 0; i < count; ++ i )
+        in >> times[i];
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+  Read string saved by QDataStream, checking its length before allocating
+*/
+static bool readString( QDataStream & in, QString & str ) {
+    quint32 bytes;
+    in >> bytes;
+
+    if ( in.status() != QDataStream::Ok )
+        return false;
+
+    if ( bytes == 0xffffffff ) { // Null string
+        str = QString();
+        return true;
+    }
+
+    if ( bytes % 2 || bytes > quint64( in.device()->bytesAvailable() ) ) {
+        in.setStatus( QDataStream::ReadCorruptData );
+        return false;
+    }
+
+    str.resize( bytes / 2 );
+
+    for ( int i = 0; i < str.length(); ++ i ) {
+        quint16 c;
+        in >> c;
+        str[i] = QChar( c );
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+  Remove damaged index, so items are fetched again in full and it's saved anew
+*/
+static void discard( QFile & file ) {
+    kWarning() << "Search index" << file.fileName() << "is damaged, removing it";
+
+    file.close();
+    file.remove();
+}
+
+bool IncidenceIndexFile::save( const QString & fileName, const QString & source, const IncidenceIndex & index ) {
+    KSaveFile file( fileName ); // Replaces previous index atomically
+
+    if ( !file.open() ) {
+        kWarning() << "Failed to save search index to" << fileName << ":" << file.errorString();
+        return false;
+    }
+
+    QDataStream out( &file );
+    out.setVersion( QDataStream::Qt_4_6 );
+
+    out << fileMagic << fileVersion << source << qint32( index.size() );
+
+    foreach ( const IncidenceRecord & record, index.records() ) {
+        out << qint64( record.id ) << qint32( record.revision ) << record.start << record.end << record.due;
+        out << record.kind << record.flags << record.percentComplete << record.title;
+
+        if ( record.flags & IncidenceRecord::Recurs )
+            out << index.occurrences( record.id );
+    }
+
+    if ( out.status() != QDataStream::Ok || !file.finalize() ) {
+        kWarning() << "Failed to save search index to" << fileName;
+        file.abort();
+        return false;
+    }
+
+    return true;
+}
+
+bool IncidenceIndexFile::load( const QString & fileName, const QString & source, IncidenceIndex & index ) {
+    QFile file( fileName );
+
+    if ( !file.open( QIODevice::ReadOnly ) || file.size() == 0 )
+        return false;
+
+    uchar * data = file.map( 0, file.size() );
+
+    if ( !data )
+        return false;
+
+    // Read mapped pages in place, without copying the whole file
+    const QByteArray bytes = QByteArray::fromRawData( reinterpret_cast<const char *>( data ), file.size() );
+    QDataStream in( bytes );
+    in.setVersion( QDataStream::Qt_4_6 );
+
+    quint32 magic, version;
+    QString savedSource;
+    qint32 count;
+
+    in >> magic >> version;
+
+    if ( magic != fileMagic || version != fileVersion ) {
+        file.unmap( data );
+        return false;
+    }
+
+    const bool sourceRead = readString( in, savedSource );
+    in >> count;
+
+    if ( !sourceRead || in.status() != QDataStream::Ok || count < 0 ) {
+        file.unmap( data );
+        discard( file );
+        return false;
+    }
+
+    if ( savedSource != source ) { // Index of other items, will be replaced by next save
+        file.unmap( data );
+        return false;
+    }
+
+    if ( count > in.device()->bytesAvailable() / minimumRecordSize ) { // Damaged count, don't allocate for it
+        file.unmap( data );
+        discard( file );
+        return false;
+    }
+
+    QVector<IncidenceRecord> records;
+    QHash<Akonadi::Item::Id, QVector<qint64> > occurrences;
+
+    records.reserve( count );
+
+    for ( int i = 0; i < count && in.status() == QDataStream::Ok; ++ i ) {
+        IncidenceRecord record;
+        qint64 id;
+        qint32 revision;
+
+        in >> id >> revision >> record.start >> record.end >> record.due;
+        in >> record.kind >> record.flags >> record.percentComplete;
+
+        if ( !readString( in, record.title ) )
+            break;
+
+        record.id = id;
+        record.revision = revision;
+        record.summary = record.title.toCaseFolded();
+
+        if ( record.flags & IncidenceRecord::Recurs && !readOccurrences( in, occurrences[ id ] ) )
+            break;
+
+        records.append( record );
+    }
+
+    const bool valid = in.status() == QDataStream::Ok && records.size() == count;
+
+    file.unmap( data );
+
+    if ( !valid ) {
+        discard( file );
+        return false;
+    }
+
+    index.insert( records, occurrences );
+
+    return true;
+}
@@ -0,0 +1,49 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCIDENCE_INDEX_FILE_H
+#define INCIDENCE_INDEX_FILE_H
+
+#include "incidence_index.h"
+
+/**
+  Search index persisted between sessions, so runner may answer queries right
+  after start and revalidate only items changed since the index was saved.
+
+  File is bound to format version and to the source of items it was built
+  from, index of other source or version is ignored.
+*/
+class IncidenceIndexFile {
+public:
+
+    /**
+      Write records and occurrences of given index
+    */
+    static bool save( const QString & fileName, const QString & source, const IncidenceIndex & index );
+
+    /**
+      Add records saved for given source to index, file is mapped into memory
+      while reading. Returns false if there is no valid index for the source,
+      damaged file is removed
+    */
+    static bool load( const QString & fileName, const QString & source, IncidenceIndex & index );
+};
+
+#endif
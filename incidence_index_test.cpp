@@ -0,0 +1,206 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incidence_index_test.h"
+#include "collection_selector.h"
+
+#include <kcal/event.h>
+#include <kcal/todo.h>
+
+#include <qtest_kde.h>
+
+static const char * const words[] = {
+    "meeting", "project", "review", "report", "dentist", "birthday", "deadline", "release"
+};
+
+static const int wordCount = sizeof( words ) / sizeof( words[0] );
+
+static QDate baseDate() {
+    return QDate( 2009, 10, 1 );
+}
+
+Akonadi::Item IncidenceIndexTest::randomItem( Akonadi::Item::Id id, int revision ) {
+    const QString summary = QString( "%1 %2" ).arg( words[ qrand() % wordCount ] ).arg( words[ qrand() % wordCount ] );
+    const QDate date = baseDate().addDays( qrand() % 30 );
+
+    KCal::Incidence::Ptr incidence;
+
+    switch ( qrand() % 4 ) {
+        case 0: { // Timed event
+            KCal::Event::Ptr event( new KCal::Event() );
+            event->setDtStart( KDateTime( date, QTime( qrand() % 24, 0 ), KDateTime::UTC ) );
+            incidence = event;
+            break;
+        }
+        case 1: { // All-day event
+            KCal::Event::Ptr event( new KCal::Event() );
+            event->setDtStart( KDateTime( date ) );
+            event->setAllDay( true );
+            incidence = event;
+            break;
+        }
+        case 2: { // Todo with due date
+            KCal::Todo::Ptr todo( new KCal::Todo() );
+            todo->setDtDue( KDateTime( date, QTime( 12, 0 ), KDateTime::UTC ) );
+            todo->setHasDueDate( true );
+            incidence = todo;
+            break;
+        }
+        default: { // Todo without dates
+            KCal::Todo::Ptr todo( new KCal::Todo() );
+            todo->setHasDueDate( false );
+            todo->setHasStartDate( false );
+            incidence = todo;
+            break;
+        }
+    }
+
+    incidence->setSummary( summary );
+
+    Akonadi::Item item( dynamic_cast<KCal::Todo *>( incidence.get() ) ? todoMimeType : eventMimeType );
+    item.setId( id );
+    item.setRevision( revision );
+    item.setPayload<KCal::Incidence::Ptr>( incidence );
+
+    return item;
+}
+
+void IncidenceIndexTest::fill( IncidenceIndex & index, int count ) {
+    Akonadi::Item::List items;
+
+    for ( int i = 1; i <= count; ++ i )
+        items.append( randomItem( i, 0 ) );
+
+    index.insert( items );
+}
+
+void IncidenceIndexTest::verify( const IncidenceIndex & index ) {
+    const QVector<IncidenceRecord> & records = index.records();
+
+    for ( int pos = 0; pos < records.size(); ++ pos )
+        QCOMPARE( index.position( records[ pos ].id ), pos );
+
+    QStringList queries;
+    queries << "e" << "me" << "meeting" << "review rep" << "ject dead" << "absent";
+
+    foreach ( const QString & query, queries ) {
+        QVector<int> expected;
+
+        for ( int pos = 0; pos < records.size(); ++ pos )
+            if ( records[ pos ].summary.contains( query ) )
+                expected.append( pos );
+
+        QVector<int> found = index.search( query );
+        qSort( found );
+
+        QCOMPARE( found, expected );
+    }
+
+    for ( int day = -1; day < 32; day += 3 ) {
+        const qint64 from = IncidenceIndex::toEpoch( KDateTime( baseDate().addDays( day ), QTime( 0, 0 ), KDateTime::UTC ) );
+        const qint64 to = from + ( day % 2 ? 3600 : 3 * 24 * 3600 ); // Hour or few days
+
+        QVector<int> expected;
+
+        for ( int pos = 0; pos < records.size(); ++ pos )
+            if ( IncidenceIndex::matches( records[ pos ], from, to ) )
+                expected.append( pos );
+
+        QVector<int> found = index.searchRange( from, to );
+        qSort( found );
+
+        QCOMPARE( found, expected );
+    }
+}
+
+void IncidenceIndexTest::testInsert() {
+    qsrand( 1 );
+
+    IncidenceIndex index;
+    fill( index, 200 );
+
+    QCOMPARE( index.size(), 200 );
+    verify( index );
+
+    index.insert( randomItem( 201, 0 ) ); // Single insert after bulk one
+    verify( index );
+}
+
+void IncidenceIndexTest::testUpdate() {
+    qsrand( 2 );
+
+    IncidenceIndex index;
+    fill( index, 200 );
+
+    for ( int i = 1; i <= 200; i += 3 )
+        index.insert( randomItem( i, 1 ) );
+
+    QCOMPARE( index.size(), 200 );
+    verify( index );
+
+    const IncidenceRecord record = index.records()[ index.position( 5 ) ];
+    index.insert( randomItem( 5, 0 ) ); // Same revision isn't indexed again
+    QCOMPARE( index.records()[ index.position( 5 ) ].summary, record.summary );
+}
+
+void IncidenceIndexTest::testRemove() {
+    qsrand( 3 );
+
+    IncidenceIndex index;
+    fill( index, 200 );
+
+    index.remove( index.records().last().id ); // No record is moved
+    verify( index );
+
+    for ( int i = 1; i <= 200; i += 2 ) // Last records are moved into freed positions
+        index.remove( i );
+
+    QCOMPARE( index.size(), 99 );
+    verify( index );
+
+    for ( int i = 300; i < 350; ++ i ) // Positions of removed records are reused
+        index.insert( randomItem( i, 0 ) );
+
+    for ( int i = 2; i <= 40; i += 2 )
+        index.insert( randomItem( i, 1 ) );
+
+    index.remove( 1000 ); // Unknown item
+
+    QCOMPARE( index.size(), 149 );
+    verify( index );
+}
+
+void IncidenceIndexTest::testRemoveAll() {
+    qsrand( 4 );
+
+    IncidenceIndex index;
+    fill( index, 50 );
+
+    for ( int i = 50; i >= 1; -- i )
+        index.remove( i );
+
+    QCOMPARE( index.size(), 0 );
+    verify( index );
+
+    fill( index, 20 );
+    verify( index );
+}
+
+QTEST_KDEMAIN_CORE(IncidenceIndexTest)
@@ -0,0 +1,129 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCIDENCE_STORE_H
+#define INCIDENCE_STORE_H
+
+//KDE-Includes
+#include <Akonadi/Item>
+#include <KConfigGroup>
+#include <kcal/incidence.h>
+
+//Qt
+#include <QHash>
+#include <QObject>
+
+/**
+  Source of calendar items for the runner. Whatever backend is used, items are
+  Akonadi items with KCal::Incidence payloads, identified by id and revision.
+
+  Fetched items and changes are delivered by signals. Store may emit them
+  synchronously, right from the call which caused them.
+*/
+class IncidenceStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IncidenceStore( QObject * parent );
+    virtual ~IncidenceStore();
+
+    /**
+      Apply runner configuration. Store emits reset() when its set of items changes
+    */
+    virtual void configure( const KConfigGroup & config );
+
+    /**
+      Check if store knows where its items are, so they may be fetched
+    */
+    virtual bool isReady() const = 0;
+
+    /**
+      Identifies set of items in the store, so items saved from one set aren't
+      taken for another. Empty if items shouldn't be saved between sessions
+    */
+    virtual QString source() const = 0;
+
+    /**
+      Start fetching all items. Items are delivered in batches by itemsReceived(),
+      followed by fetchFinished(). Items which revisions are already known may be
+      delivered without payload
+    */
+    virtual void fetch( const QHash<Akonadi::Item::Id, int> & knownRevisions ) = 0;
+
+    /**
+      Abort running fetch, nothing more is delivered for it
+    */
+    virtual void abortFetch() = 0;
+
+    /**
+      Start fetching single item with full payload, it is delivered by itemFetched()
+    */
+    virtual void fetchItem( Akonadi::Item::Id id ) = 0;
+
+    /**
+      Store new incidence. Returns id of the write, which result is reported by
+      writeFinished(), or 0 if there is no place for incidences of its kind
+    */
+    virtual int create( const KCal::Incidence::Ptr & incidence ) = 0;
+
+    /**
+      Store modified payload of existing item, returns id of the write
+    */
+    virtual int modify( const Akonadi::Item & item ) = 0;
+
+signals:
+
+    void itemsReceived( const Akonadi::Item::List & items );
+    void fetchFinished( bool success );
+
+    void itemFetched( const Akonadi::Item & item, bool success );
+
+    /**
+      Item was added or changed after fetch
+    */
+    void itemStored( const Akonadi::Item & item );
+    void itemRemoved( const Akonadi::Item & item );
+
+    /**
+      Write was accepted by the store. Item of created incidence has no id yet
+    */
+    void writeSubmitted( int writeId, const Akonadi::Item & item );
+
+    /**
+      Write finished, with stored item in case of success
+    */
+    void writeFinished( int writeId, const Akonadi::Item & item, bool success );
+
+    /**
+      Set of items changed completely, previously fetched items are no longer valid
+    */
+    void reset();
+
+protected:
+
+    int nextWriteId() { return ++ lastWriteId; }
+
+private:
+
+    int lastWriteId;
+};
+
+#endif
@@ -0,0 +1,413 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Project-Includes
+#include "item_cache.h"
+#include "incidence_index_file.h"
+#include "incidence_store.h"
+#include "metrics_registry.h"
+
+//KDE-Includes
+#include <kcal/incidence.h>
+
+//Qt-Includes
+#include <QTimer>
+
+using namespace Akonadi;
+
+ItemCache::ItemCache( IncidenceStore * store, MetricsRegistry & metrics, QObject * parent ) : QObject( parent ), store( store ), occurrencePastDays( 30 ), occurrenceFutureDays( 365 ), state( NotLoaded ), indexChanged( false ), currentSnapshot( 0 ), publishedSnapshots( 0 ) {
+    itemCountMetric = metrics.gauge( "cache.items" );
+    sizeMetric = metrics.gauge( "cache.kbytes" );
+    reloadMetric = metrics.counter( "cache.reloads" );
+    refreshMetric = metrics.timestamp( "cache.refreshed" );
+    fetchMetric = metrics.counter( "fetch.runs" );
+    fetchFailureMetric = metrics.counter( "fetch.failures" );
+    fetchedItemMetric = metrics.counter( "fetch.items" );
+    fetchTimeMetric = metrics.counter( "fetch.time-ms" );
+    lastFetchTimeMetric = metrics.gauge( "fetch.last-ms" );
+
+    connect( &metrics, SIGNAL( aboutToReport() ), this, SLOT( updateMetrics() ) );
+
+    occurrenceWindowTimer = new QTimer( this );
+    occurrenceWindowTimer->setInterval( 24 * 3600 * 1000 ); // Move window once a day
+    occurrenceWindowTimer->start();
+
+    connect( occurrenceWindowTimer, SIGNAL( timeout() ), this, SLOT( updateOccurrenceWindow() ) );
+
+    retireTimer = new QTimer( this );
+    retireTimer->setInterval( 1000 ); // Far longer than reader needs to reference loaded snapshot
+
+    connect( retireTimer, SIGNAL( timeout() ), this, SLOT( releaseRetired() ) );
+
+    updateOccurrenceWindow(); // Also publishes initial empty snapshot
+
+    connect( store, SIGNAL( itemsReceived(Akonadi::Item::List) ), this, SLOT( itemsReceived(Akonadi::Item::List) ) );
+    connect( store, SIGNAL( fetchFinished(bool) ), this, SLOT( fetchFinished(bool) ) );
+    connect( store, SIGNAL( itemStored(Akonadi::Item) ), this, SLOT( itemStored(Akonadi::Item) ) );
+    connect( store, SIGNAL( itemRemoved(Akonadi::Item) ), this, SLOT( itemRemoved(Akonadi::Item) ) );
+    connect( store, SIGNAL( reset() ), this, SLOT( reset() ) );
+    connect( store, SIGNAL( writeSubmitted(int,Akonadi::Item) ), this, SLOT( writeSubmitted(int,Akonadi::Item) ) );
+    connect( store, SIGNAL( writeFinished(int,Akonadi::Item,bool) ), this, SLOT( writeFinished(int,Akonadi::Item,bool) ) );
+
+    load(); // Stores which need no configuration are ready right away
+}
+
+ItemCache::~ItemCache() {
+    saveIndex();
+}
+
+void ItemCache::setIndexFile( const QString & fileName ) {
+    indexFileName = fileName;
+
+    if ( state != NotLoaded || !cachedItems.isEmpty() )
+        return;
+
+    restoreIndex();
+    publish(); // Answer queries from saved items while store isn't ready
+}
+
+void ItemCache::reset() {
+    store->abortFetch();
+    reloadMetric->add( 1 );
+
+    if ( state == NotLoaded && !indexSource.isEmpty() && indexSource == store->source() ) { // Store became ready with items restored for it
+        load();
+        return;
+    }
+
+    if ( state == Loaded )
+        saveIndex(); // Keep items of previous source for the case it comes back
+
+    cachedItems.clear();
+    index.clear();
+    pendingWrites.clear();
+    state = NotLoaded;
+
+    load(); // Preload items of new collections
+}
+
+void ItemCache::setOccurrenceWindow( int pastDays, int futureDays ) {
+    if ( pastDays == occurrencePastDays && futureDays == occurrenceFutureDays )
+        return;
+
+    occurrencePastDays = pastDays;
+    occurrenceFutureDays = futureDays;
+
+    updateOccurrenceWindow();
+}
+
+void ItemCache::updateOccurrenceWindow() {
+    const QDate today = QDate::currentDate();
+    const qint64 from = IncidenceIndex::toEpoch( KDateTime( today.addDays( -occurrencePastDays ) ) );
+    const qint64 to = IncidenceIndex::toEpoch( KDateTime( today.addDays( occurrenceFutureDays + 1 ) ) ) - 1;
+
+    index.setOccurrenceWindow( from, to, cachedItems );
+
+    publish();
+}
+
+ItemCache::SnapshotPtr ItemCache::snapshot() const {
+    return SnapshotPtr( currentSnapshot ); // Stays alive for a grace period after being replaced, so it may be referenced here
+}
+
+void ItemCache::publish() {
+    SnapshotPtr snapshot( new Snapshot() );
+    snapshot->items = cachedItems; // Implicitly shared, so no copy is made here
+    snapshot->index = index;
+    snapshot->loaded = ( state == Loaded );
+    snapshot->generation = publishedSnapshots ++;
+
+    currentSnapshot.fetchAndStoreOrdered( snapshot.data() );
+    qSwap( publishedSnapshot, snapshot );
+
+    if ( !snapshot )
+        return;
+
+    retiredSnapshots.append( snapshot ); // Reader may have loaded its pointer, but not referenced it yet
+
+    if ( !retireTimer->isActive() )
+        retireTimer->start();
+}
+
+void ItemCache::releaseRetired() {
+    expiredSnapshots.clear(); // Retired at least a full interval ago, so every reader has referenced them, or released by last reader
+    qSwap( expiredSnapshots, retiredSnapshots );
+
+    if ( expiredSnapshots.isEmpty() )
+        retireTimer->stop();
+}
+
+void ItemCache::load() {
+    if ( !store->isReady() || state != NotLoaded )
+        return;
+
+    if ( cachedItems.isEmpty() )
+        restoreIndex();
+
+    QHash<Item::Id, int> knownRevisions;
+
+    foreach ( const IncidenceRecord & record, index.records() ) // Recurring events need payload to expand new occurrences
+        if ( !( record.flags & IncidenceRecord::Recurs ) || cachedItems.value( record.id ).hasPayload() )
+            knownRevisions.insert( record.id, record.revision );
+
+    state = Loading;
+    removedItems.clear();
+    loadedItems.clear();
+
+    publish();
+
+    fetchMetric->add( 1 );
+    fetchTime.start();
+
+    store->fetch( knownRevisions ); // Items may be delivered right away
+}
+
+Item ItemCache::cachedCopy( const Item & item ) const {
+    const int pos = index.position( item.id() );
+
+    if ( pos >= 0 && ( index.records()[ pos ].flags & IncidenceRecord::Recurs ) )
+        return item;
+
+    Item copy( item.id() );
+    copy.setRevision( item.revision() );
+    copy.setMimeType( item.mimeType() );
+
+    return copy;
+}
+
+void ItemCache::restoreIndex() {
+    indexSource = store->source();
+
+    if ( indexFileName.isEmpty() || indexSource.isEmpty() )
+        return;
+
+    if ( !IncidenceIndexFile::load( indexFileName, indexSource, index ) )
+        return;
+
+    foreach ( const IncidenceRecord & record, index.records() ) { // Items without payload, until they are needed
+        Item item( record.id );
+        item.setRevision( record.revision );
+
+        cachedItems.insert( record.id, item );
+    }
+
+    indexChanged = false;
+}
+
+void ItemCache::saveIndex() {
+    if ( indexFileName.isEmpty() || indexSource.isEmpty() || !indexChanged || state != Loaded )
+        return;
+
+    if ( IncidenceIndexFile::save( indexFileName, indexSource, index ) )
+        indexChanged = false;
+}
+
+void ItemCache::itemsReceived( const Item::List & items ) {
+    Item::List receivedItems;
+
+    fetchedItemMetric->add( items.size() );
+
+    foreach ( const Item & item, items ) {
+        if ( removedItems.contains( item.id() ) ) // Item was removed after the fetch started
+            continue;
+
+        loadedItems.insert( item.id() );
+
+        QHash<Item::Id, Item>::const_iterator it = cachedItems.constFind( item.id() );
+
+        if ( it != cachedItems.constEnd() && it.value().revision() >= item.revision() ) {
+            if ( it.value().hasPayload() || !item.hasPayload() || it.value().revision() > item.revision() )
+                continue; // Already have this or newer revision
+
+            index.remove( item.id() ); // Restored record, rebuild it from payload
+        }
+
+        receivedItems.append( item );
+    }
+
+    if ( receivedItems.isEmpty() )
+        return; // Nothing new, restored items are still current
+
+    index.insert( receivedItems );
+
+    foreach ( const Item & item, receivedItems )
+        cachedItems.insert( item.id(), cachedCopy( item ) );
+
+    indexChanged = true;
+
+    publish(); // Make partially loaded items available for matching
+}
+
+void ItemCache::fetchFinished( bool success ) {
+    state = success ? Loaded : NotLoaded; // Failed loading will be retried on next session
+
+    fetchTimeMetric->add( fetchTime.elapsed() );
+    lastFetchTimeMetric->set( fetchTime.elapsed() );
+
+    if ( success ) { // Drop restored items, which were removed since the index was saved
+        foreach ( const PendingWrite & write, pendingWrites ) // Written items aren't confirmed by the store yet
+            loadedItems.insert( write.id );
+
+        foreach ( Item::Id id, cachedItems.keys() ) {
+            if ( !loadedItems.contains( id ) ) {
+                cachedItems.remove( id );
+                index.remove( id );
+                indexChanged = true;
+            }
+        }
+
+        refreshMetric->touch();
+    } else {
+        fetchFailureMetric->add( 1 );
+    }
+
+    loadedItems.clear();
+
+    publish();
+
+    if ( success )
+        saveIndex();
+}
+
+void ItemCache::itemStored( const Item & item ) {
+    if ( state == NotLoaded ) // Item will be received with the whole collection
+        return;
+
+    if ( !item.hasPayload() ) // Notification without payload is useless for matching
+        return;
+
+    QHash<Item::Id, Item>::const_iterator it = cachedItems.constFind( item.id() );
+
+    if ( it != cachedItems.constEnd() && it.value().revision() > item.revision() )
+        return; // Already have newer revision
+
+    index.insert( item );
+    cachedItems.insert( item.id(), cachedCopy( item ) );
+    removedItems.remove( item.id() );
+    indexChanged = true;
+
+    if ( state == Loading )
+        loadedItems.insert( item.id() );
+
+    publish();
+}
+
+void ItemCache::itemRemoved( const Item & item ) {
+    if ( state == Loading )
+        removedItems.insert( item.id() );
+
+    if ( cachedItems.remove( item.id() ) ) {
+        index.remove( item.id() );
+        indexChanged = true;
+        publish();
+    }
+}
+
+void ItemCache::writeSubmitted( int writeId, const Item & item ) {
+    if ( state == NotLoaded || !item.hasPayload() ) // Will be received with the whole collection
+        return;
+
+    PendingWrite write;
+    write.created = !item.isValid();
+    write.id = write.created ? -writeId : item.id();
+    write.revision = item.revision();
+
+    const int pos = index.position( write.id );
+
+    write.indexed = pos >= 0;
+
+    if ( write.indexed ) {
+        write.record = index.records()[ pos ];
+        write.occurrences = index.occurrences( write.id );
+    }
+
+    write.item = cachedItems.value( write.id );
+
+    Item written( item );
+    written.setId( write.id );
+
+    index.remove( write.id ); // Revision isn't changed yet, so record wouldn't be rebuilt
+    index.insert( written );
+    cachedItems.insert( write.id, cachedCopy( written ) );
+
+    pendingWrites.insert( writeId, write );
+
+    publish();
+}
+
+void ItemCache::writeFinished( int writeId, const Item & item, bool success ) {
+    QHash<int, PendingWrite>::iterator it = pendingWrites.find( writeId );
+
+    if ( it == pendingWrites.end() )
+        return;
+
+    const PendingWrite write = it.value();
+
+    pendingWrites.erase( it );
+
+    if ( write.created ) { // Temporary item is replaced by the stored one
+        cachedItems.remove( write.id );
+        index.remove( write.id );
+    }
+
+    if ( success ) {
+        if ( item.hasPayload() )
+            itemStored( item ); // Reconcile with revision assigned by the store
+        else
+            publish();
+
+        return;
+    }
+
+    if ( !write.created && cachedItems.value( write.id ).revision() == write.revision ) { // Item wasn't changed by anyone else since the write
+        index.remove( write.id );
+
+        if ( write.indexed ) {
+            QHash<Item::Id, QVector<qint64> > occurrences;
+            occurrences.insert( write.id, write.occurrences );
+
+            index.insert( QVector<IncidenceRecord>() << write.record, occurrences );
+        }
+
+        if ( write.item.isValid() )
+            cachedItems.insert( write.id, write.item );
+        else
+            cachedItems.remove( write.id );
+    }
+
+    publish();
+}
+
+void ItemCache::updateMetrics() {
+    qint64 size = index.approximateSize() + cachedItems.size() * ( sizeof( Item ) + sizeof( Item::Id ) + 32 ); // Item data and hash node
+
+    foreach ( Item::Id id, index.recurringItems() ) { // Payloads are kept only for recurring events
+        const Item item = cachedItems.value( id );
+
+        if ( item.hasPayload<KCal::Incidence::Ptr>() ) {
+            KCal::Incidence::Ptr incidence = item.payload<KCal::Incidence::Ptr>();
+
+            size += 1024 + ( incidence->summary().size() + incidence->description().size() + incidence->location().size() ) * sizeof( QChar ); // Rough size of incidence object
+        }
+    }
+
+    itemCountMetric->set( cachedItems.size() );
+    sizeMetric->set( size / 1024 );
+}
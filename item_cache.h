@@ -0,0 +1,222 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ITEM_CACHE_H
+#define ITEM_CACHE_H
+
+//Project-Includes
+#include "incidence_index.h"
+
+//KDE-Includes
+#include <Akonadi/Item>
+
+//Qt
+#include <QAtomicPointer>
+#include <QSharedData>
+#include <QHash>
+#include <QSet>
+#include <QTime>
+
+class IncidenceStore;
+class Metric;
+class MetricsRegistry;
+class QTimer;
+
+/**
+  Cache of calendar items, which is loaded asynchroniously once and
+  then kept up to date by change notifications of the store.
+
+  Full payloads are needed only to build index records, so they are dropped
+  after indexing, except for recurring events. Actions on items should fetch
+  them from the store.
+
+  Cache is modified only in the main thread, and each modification publishes
+  new immutable snapshot. Match threads reference current snapshot without
+  any locking, so replaced snapshots are released only after a grace period.
+*/
+class ItemCache : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /**
+      Immutable state of the cache. Never modified after being published
+    */
+    class Snapshot : public QSharedData {
+    public:
+        Snapshot() : loaded( false ), generation( 0 ) {}
+
+        QHash<Akonadi::Item::Id, Akonadi::Item> items;
+        IncidenceIndex index; // Search records of items
+        bool loaded;
+        int generation; // Number of snapshots published before this one, identifies it without keeping it alive
+    };
+
+    typedef QExplicitlySharedDataPointer<Snapshot> SnapshotPtr;
+
+public:
+    ItemCache( IncidenceStore * store, MetricsRegistry & metrics, QObject * parent );
+    ~ItemCache();
+
+    /**
+      Set number of days before and after today, for which occurrences
+      of recurring events are expanded and indexed
+    */
+    void setOccurrenceWindow( int pastDays, int futureDays );
+
+    /**
+      Set file where search index is saved between sessions. Saved items are
+      restored right away, so they are available before the store is ready,
+      and only changed ones are fetched again
+    */
+    void setIndexFile( const QString & fileName );
+
+    /**
+      Current state of the cache. Never blocks: while cache is loading only
+      already received items are present in it
+    */
+    SnapshotPtr snapshot() const;
+
+    bool isLoaded() const { return snapshot()->loaded; }
+
+public slots:
+
+    /**
+      Start loading items in background if they are not loaded yet
+    */
+    void load();
+
+private slots:
+
+    void itemsReceived( const Akonadi::Item::List & items );
+    void fetchFinished( bool success );
+
+    /**
+      Drop all items and load them again
+    */
+    void reset();
+
+    /**
+      Move occurrence window to be relative to current day
+    */
+    void updateOccurrenceWindow();
+
+    void itemStored( const Akonadi::Item & item );
+    void itemRemoved( const Akonadi::Item & item );
+
+    /**
+      Apply write right away, so its effect may be found before the store
+      confirms it. Created items get temporary negative ids
+    */
+    void writeSubmitted( int writeId, const Akonadi::Item & item );
+
+    /**
+      Replace optimistically applied write with stored item, or roll it back
+    */
+    void writeFinished( int writeId, const Akonadi::Item & item, bool success );
+
+    /**
+      Sample size of the cache before metrics are reported
+    */
+    void updateMetrics();
+
+    /**
+      Release snapshots replaced more than a grace period ago
+    */
+    void releaseRetired();
+
+private:
+
+    enum State {
+        NotLoaded,
+        Loading,
+        Loaded
+    };
+
+    /**
+      Write applied to the cache before its result is known, with the state
+      of the item before it
+    */
+    struct PendingWrite {
+        Akonadi::Item::Id id;
+        int revision; // Revision of written item
+        bool created;
+        bool indexed; // Whether item had a record before the write
+        IncidenceRecord record;
+        QVector<qint64> occurrences;
+        Akonadi::Item item;
+    };
+
+private:
+
+    /**
+      Publish current items as new snapshot for readers
+    */
+    void publish();
+
+    /**
+      Copy of indexed item to keep in the cache. Payload is kept only for recurring
+      events, which occurrences are expanded from it, other items are described by
+      their index records
+    */
+    Akonadi::Item cachedCopy( const Akonadi::Item & item ) const;
+
+    /**
+      Restore items saved in previous session, if they are from the same source
+    */
+    void restoreIndex();
+    void saveIndex();
+
+private:
+
+    IncidenceStore * store;
+
+    int occurrencePastDays, occurrenceFutureDays;
+    QTimer * occurrenceWindowTimer;
+
+    // Working copy of the cache, accessed only from the main thread
+    QHash<Akonadi::Item::Id, Akonadi::Item> cachedItems;
+    IncidenceIndex index;
+    QSet<Akonadi::Item::Id> removedItems; // Items removed while cache was loading
+    QSet<Akonadi::Item::Id> loadedItems; // Items confirmed by the store while cache was loading
+    State state;
+
+    QHash<int, PendingWrite> pendingWrites; // By write id
+
+    QString indexFileName;
+    QString indexSource; // Source of items in the cache
+    bool indexChanged; // Whether items changed since the index was saved
+
+    QTime fetchTime; // Time since current fetch started
+    Metric * itemCountMetric, * sizeMetric;
+    Metric * reloadMetric, * refreshMetric;
+    Metric * fetchMetric, * fetchFailureMetric, * fetchedItemMetric, * fetchTimeMetric, * lastFetchTimeMetric;
+
+    QAtomicPointer<Snapshot> currentSnapshot; // Read by match threads, referenced by publishedSnapshot
+    SnapshotPtr publishedSnapshot;
+    int publishedSnapshots;
+
+    // Replaced snapshots, which readers may be about to reference
+    QList<SnapshotPtr> retiredSnapshots, expiredSnapshots;
+    QTimer * retireTimer;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "keyword_trie.h"
+
+#include <algorithm>
+
+KeywordTrie::KeywordTrie() : nodes( 1 ), shortestKeyword( 0 ) {
+}
+
+void KeywordTrie::insert( const QString & keyword, int command ) {
+    if ( keyword.isEmpty() )
+        return;
+
+    int node = 0;
+
+    foreach ( const QChar c, keyword ) {
+        const Edge edge = { c.toCaseFolded(), nodes.size() };
+
+        QVector<Edge> & edges = nodes[ node ].edges;
+        QVector<Edge>::iterator it = std::lower_bound( edges.begin(), edges.end(), edge );
+
+        if ( it != edges.end() && it->c == edge.c ) {
+            node = it->node;
+        } else {
+            edges.insert( it, edge );
+            nodes.append( Node() ); // Invalidates edges reference, which isn't used anymore
+            node = edge.node;
+        }
+    }
+
+    nodes[ node ].command = command;
+
+    if ( shortestKeyword == 0 || keyword.length() < shortestKeyword )
+        shortestKeyword = keyword.length();
+}
+
+int KeywordTrie::find( const QString & query, int & length ) const {
+    int command = -1;
+    int node = 0;
+
+    for ( int i = 0; i < query.length(); ++ i ) {
+        node = child( node, query[i].toCaseFolded() );
+
+        if ( node < 0 )
+            break;
+
+        if ( nodes[ node ].command >= 0 && ( i + 1 == query.length() || !query[i + 1].isLetterOrNumber() ) ) { // Keyword ends at word boundary
+            command = nodes[ node ].command;
+            length = i + 1;
+        }
+    }
+
+    return command;
+}
+
+int KeywordTrie::child( int node, QChar c ) const {
+    const QVector<Edge> & edges = nodes[ node ].edges;
+    const Edge key = { c, 0 };
+
+    QVector<Edge>::const_iterator it = std::lower_bound( edges.begin(), edges.end(), key );
+
+    if ( it == edges.end() || it->c != c )
+        return -1;
+
+    return it->node;
+}
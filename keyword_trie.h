@@ -0,0 +1,84 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYWORD_TRIE_H
+#define KEYWORD_TRIE_H
+
+#include <QString>
+#include <QVector>
+
+/**
+  Prefix tree of command keywords. Any number of aliases may lead to the same
+  command, and command of a query is found in single pass over its prefix,
+  so cost of lookup doesn't depend on the number of keywords.
+
+  Keywords are matched case-insensitively and only as whole words, so longer
+  keyword wins over its prefix ("events" over "event") and short aliases
+  don't match beginnings of other words.
+*/
+class KeywordTrie {
+public:
+    KeywordTrie();
+
+    /**
+      Add keyword leading to given command, which should be non-negative.
+      Empty keywords are ignored, keyword added again is reassigned
+    */
+    void insert( const QString & keyword, int command );
+
+    /**
+      Find command of longest keyword which query starts with, and set length
+      to the length of that keyword. Returns -1 if query starts with no keyword
+    */
+    int find( const QString & query, int & length ) const;
+
+    /**
+      Length of shortest keyword, or 0 if there are no keywords
+    */
+    int minimumLength() const { return shortestKeyword; }
+
+private:
+
+    struct Edge {
+        QChar c;
+        int node;
+
+        bool operator<( const Edge & other ) const { return c < other.c; }
+    };
+
+    struct Node {
+        Node() : command( -1 ) {}
+
+        QVector<Edge> edges; // Sorted by character
+        int command; // Command of keyword ending at this node, or -1
+    };
+
+    /**
+      Child of given node by character, or -1 if there is no such child
+    */
+    int child( int node, QChar c ) const;
+
+private:
+
+    QVector<Node> nodes; // Root is the first
+    int shortestKeyword;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "keyword_trie_test.h"
+#include "keyword_trie.h"
+
+enum { Event, Events, Todo };
+
+void KeywordTrieTest::testLongestKeyword() {
+    KeywordTrie trie;
+    trie.insert( "event", Event );
+    trie.insert( "events", Events );
+    trie.insert( "todo", Todo );
+
+    int length = 0;
+
+    QCOMPARE( trie.find( "event meeting; tomorrow", length ), int( Event ) );
+    QCOMPARE( length, 5 );
+
+    QCOMPARE( trie.find( "events tomorrow", length ), int( Events ) );
+    QCOMPARE( length, 6 );
+
+    QCOMPARE( trie.find( "todo shopping; today", length ), int( Todo ) ); // Sliced by its own keyword
+    QCOMPARE( length, 4 );
+
+    QCOMPARE( trie.find( "events", length ), int( Events ) );
+    QCOMPARE( trie.find( "even", length ), -1 );
+    QCOMPARE( trie.find( "", length ), -1 );
+
+    QCOMPARE( trie.minimumLength(), 4 );
+}
+
+void KeywordTrieTest::testAliases() {
+    KeywordTrie trie;
+    trie.insert( "event", Event );
+    trie.insert( "termin", Event );
+    trie.insert( "ev", Event );
+    trie.insert( "td", Todo );
+
+    int length = 0;
+
+    QCOMPARE( trie.find( "termin meeting; tomorrow", length ), int( Event ) );
+    QCOMPARE( length, 6 );
+
+    QCOMPARE( trie.find( "ev meeting; tomorrow", length ), int( Event ) );
+    QCOMPARE( length, 2 );
+
+    QCOMPARE( trie.find( "TD shopping; today", length ), int( Todo ) ); // Case-insensitive
+    QCOMPARE( length, 2 );
+
+    QCOMPARE( trie.minimumLength(), 2 );
+}
+
+void KeywordTrieTest::testWordBoundary() {
+    KeywordTrie trie;
+    trie.insert( "ev", Event );
+    trie.insert( "event", Event );
+    trie.insert( "events", Events );
+
+    int length = 0;
+
+    QCOMPARE( trie.find( "evening", length ), -1 );
+    QCOMPARE( trie.find( "eventually", length ), -1 );
+
+    QCOMPARE( trie.find( "eventsx", length ), -1 );
+
+    QCOMPARE( trie.find( "event;meeting;tomorrow", length ), int( Event ) );
+    QCOMPARE( length, 5 );
+}
+
+QTEST_MAIN(KeywordTrieTest)
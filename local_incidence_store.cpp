@@ -0,0 +1,138 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Project-Includes
+#include "local_incidence_store.h"
+#include "collection_selector.h"
+
+//KDE-Includes
+#include <KDebug>
+#include <kcal/calendarlocal.h>
+#include <kcal/event.h>
+#include <kcal/todo.h>
+
+using Akonadi::Item;
+
+LocalIncidenceStore::LocalIncidenceStore( QObject * parent ) : IncidenceStore( parent ), nextId( 1 ) {
+}
+
+bool LocalIncidenceStore::load( const QString & file ) {
+    KCal::CalendarLocal calendar( KDateTime::Spec::LocalZone() );
+
+    if ( !calendar.load( file ) ) {
+        kWarning() << "Failed to load calendar from" << file;
+        return false;
+    }
+
+    foreach ( KCal::Incidence * incidence, calendar.rawIncidences() )
+        add( KCal::Incidence::Ptr( incidence->clone() ) ); // Calendar owns its incidences
+
+    fileName = file;
+
+    emit reset();
+
+    return true;
+}
+
+Item LocalIncidenceStore::add( const KCal::Incidence::Ptr & incidence ) {
+    Item item( dynamic_cast<KCal::Todo *>( incidence.get() ) ? todoMimeType : eventMimeType );
+    item.setId( nextId ++ );
+    item.setRevision( 0 );
+    item.setPayload<KCal::Incidence::Ptr>( incidence );
+
+    storedItems.insert( item.id(), item );
+
+    return item;
+}
+
+void LocalIncidenceStore::fetch( const QHash<Item::Id, int> & knownRevisions ) {
+    Q_UNUSED( knownRevisions ) // Payloads are already in memory
+
+    emit itemsReceived( storedItems.values() );
+    emit fetchFinished( true );
+}
+
+void LocalIncidenceStore::fetchItem( Item::Id id ) {
+    QHash<Item::Id, Item>::const_iterator it = storedItems.constFind( id );
+
+    if ( it != storedItems.constEnd() )
+        emit itemFetched( it.value(), true );
+    else
+        emit itemFetched( Item( id ), false );
+}
+
+int LocalIncidenceStore::create( const KCal::Incidence::Ptr & incidence ) {
+    const int writeId = nextWriteId();
+
+    Item submitted( dynamic_cast<KCal::Todo *>( incidence.get() ) ? todoMimeType : eventMimeType );
+    submitted.setPayload<KCal::Incidence::Ptr>( incidence );
+
+    emit writeSubmitted( writeId, submitted );
+
+    const Item item = add( incidence );
+
+    save();
+
+    emit itemStored( item );
+    emit writeFinished( writeId, item, true );
+
+    return writeId;
+}
+
+int LocalIncidenceStore::modify( const Item & item ) {
+    const int writeId = nextWriteId();
+
+    emit writeSubmitted( writeId, item );
+
+    if ( !storedItems.contains( item.id() ) ) {
+        kWarning() << "Modified item isn't stored:" << item.id();
+        emit writeFinished( writeId, item, false );
+        return writeId;
+    }
+
+    Item stored( item );
+    stored.setRevision( storedItems[ item.id() ].revision() + 1 );
+
+    storedItems.insert( stored.id(), stored );
+
+    save();
+
+    emit itemStored( stored );
+    emit writeFinished( writeId, stored, true );
+
+    return writeId;
+}
+
+bool LocalIncidenceStore::save() const {
+    if ( fileName.isEmpty() )
+        return true;
+
+    KCal::CalendarLocal calendar( KDateTime::Spec::LocalZone() );
+
+    foreach ( const Item & item, storedItems )
+        calendar.addIncidence( item.payload<KCal::Incidence::Ptr>()->clone() ); // Calendar takes ownership of the copy
+
+    if ( !calendar.save( fileName ) ) {
+        kWarning() << "Failed to save calendar to" << fileName;
+        return false;
+    }
+
+    return true;
+}
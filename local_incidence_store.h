@@ -0,0 +1,77 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOCAL_INCIDENCE_STORE_H
+#define LOCAL_INCIDENCE_STORE_H
+
+//Project-Includes
+#include "incidence_store.h"
+
+//Qt
+#include <QHash>
+
+/**
+  Store of incidences kept in memory, optionally backed by iCalendar file.
+  Needs no services, so runner may be tested and benchmarked with it.
+  Everything is delivered synchronously.
+*/
+class LocalIncidenceStore : public IncidenceStore
+{
+    Q_OBJECT
+
+public:
+    explicit LocalIncidenceStore( QObject * parent );
+
+    /**
+      Load incidences from iCalendar file, which is then updated on each change
+    */
+    bool load( const QString & fileName );
+
+    /**
+      Add incidence without any notification, for filling store before fetching
+    */
+    Akonadi::Item add( const KCal::Incidence::Ptr & incidence );
+
+    const QHash<Akonadi::Item::Id, Akonadi::Item> & items() const { return storedItems; }
+
+    bool isReady() const { return true; }
+
+    QString source() const { return QString(); } // Nothing to gain from saving items kept in memory
+
+    void fetch( const QHash<Akonadi::Item::Id, int> & knownRevisions );
+    void abortFetch() {}
+
+    void fetchItem( Akonadi::Item::Id id );
+
+    int create( const KCal::Incidence::Ptr & incidence );
+    int modify( const Akonadi::Item & item );
+
+private:
+
+    bool save() const;
+
+private:
+
+    QHash<Akonadi::Item::Id, Akonadi::Item> storedItems;
+    Akonadi::Item::Id nextId;
+    QString fileName; // Empty if store isn't backed by file
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "match_profiler.h"
+
+#include <QTextStream>
+
+#include <time.h>
+
+LatencyHistogram::LatencyHistogram() {
+}
+
+int LatencyHistogram::bucket( qint64 nsecs ) {
+    if ( nsecs < 4 )
+        return int( qMax( nsecs, qint64( 0 ) ) );
+
+    int bits = 0; // Position of the highest bit
+
+    while ( ( nsecs >> ( bits + 1 ) ) != 0 )
+        ++ bits;
+
+    const int sub = ( nsecs >> ( bits - 2 ) ) & 3; // Two bits after the highest one
+
+    return qMin( bits * 4 + sub, bucketCount - 1 );
+}
+
+qint64 LatencyHistogram::bucketLimit( int bucket ) {
+    if ( bucket < 4 )
+        return bucket;
+
+    const int bits = bucket / 4;
+    const int sub = bucket % 4;
+
+    return ( ( qint64( 4 + sub + 1 ) ) << ( bits - 2 ) ) - 1;
+}
+
+void LatencyHistogram::record( qint64 nsecs ) {
+    counts[ bucket( nsecs ) ].ref();
+    total.ref();
+}
+
+void LatencyHistogram::reset() {
+    for ( int i = 0; i < bucketCount; ++ i )
+        counts[i] = 0;
+
+    total = 0;
+}
+
+qint64 LatencyHistogram::percentile( qreal share ) const {
+    const int target = qMax( 1, qRound( total * share ) );
+    int accumulated = 0;
+
+    for ( int i = 0; i < bucketCount; ++ i ) {
+        accumulated += counts[i];
+
+        if ( accumulated >= target )
+            return bucketLimit( i );
+    }
+
+    return 0; // Nothing recorded
+}
+
+MatchProfiler::MatchProfiler( const QStringList & keywords ) : keywords( keywords ), enabled( 0 ) {
+    histograms = new LatencyHistogram[ ( keywords.size() + 1 ) * PhaseCount ];
+}
+
+MatchProfiler::~MatchProfiler() {
+    delete [] histograms;
+}
+
+void MatchProfiler::record( int keyword, Phase phase, qint64 nsecs ) {
+    histograms[ ( keyword + 1 ) * PhaseCount + phase ].record( nsecs );
+}
+
+void MatchProfiler::reset() {
+    for ( int i = 0; i < ( keywords.size() + 1 ) * PhaseCount; ++ i )
+        histograms[i].reset();
+}
+
+QString MatchProfiler::report() const {
+    QString result;
+    QTextStream out( &result );
+
+    out << "keyword\tphase\tcount\tp50 us\tp95 us\tp99 us\n";
+
+    for ( int keyword = -1; keyword < keywords.size(); ++ keyword ) {
+        for ( int phase = 0; phase < PhaseCount; ++ phase ) {
+            const LatencyHistogram & histogram = histograms[ ( keyword + 1 ) * PhaseCount + phase ];
+
+            if ( histogram.count() == 0 )
+                continue;
+
+            out << ( keyword < 0 ? QString( "-" ) : keywords[ keyword ] ) << '\t' << phaseName( Phase( phase ) ) << '\t' << histogram.count();
+
+            foreach ( qreal share, QList<qreal>() << 0.5 << 0.95 << 0.99 )
+                out << '\t' << QString::number( histogram.percentile( share ) / 1000.0, 'f', 1 );
+
+            out << '\n';
+        }
+    }
+
+    out.flush();
+
+    return result;
+}
+
+qint64 MatchProfiler::now() {
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return qint64( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+const char * MatchProfiler::phaseName( Phase phase ) {
+    switch ( phase ) {
+        case Dispatch: return "dispatch";
+        case SplitArguments: return "split";
+        case ParseRange: return "parse-range";
+        case Snapshot: return "snapshot";
+        case Search: return "search";
+        case CreateMatches: return "create-matches";
+        case Total: return "total";
+        default: return "?";
+    }
+}
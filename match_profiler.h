@@ -0,0 +1,156 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MATCH_PROFILER_H
+#define MATCH_PROFILER_H
+
+#include <QAtomicInt>
+#include <QStringList>
+
+/**
+  Histogram of latencies with log-linear buckets: four buckets per power of
+  two, so percentiles are accurate within 19%. Recording is lock-free.
+*/
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record( qint64 nsecs );
+
+    void reset();
+
+    int count() const { return total; }
+
+    /**
+      Upper bound of latency below which given share of recorded ones fall, in nanoseconds
+    */
+    qint64 percentile( qreal share ) const;
+
+private:
+
+    static const int bucketCount = 4 * 40; // Up to about 18 minutes
+
+    static int bucket( qint64 nsecs );
+    static qint64 bucketLimit( int bucket );
+
+private:
+
+    QAtomicInt counts[ bucketCount ];
+    QAtomicInt total;
+};
+
+/**
+  Latency histograms of match phases per query keyword. When disabled,
+  queries only check the flag and never read the clock.
+*/
+class MatchProfiler {
+public:
+    enum Phase {
+        Dispatch, // Keyword recognition
+        SplitArguments,
+        ParseRange,
+        Snapshot, // Taking snapshot of cached items
+        Search, // Scan of index
+        CreateMatches,
+        Total,
+        PhaseCount
+    };
+
+public:
+
+    /**
+      Create profiler for given keywords, queries without keyword are profiled separately
+    */
+    explicit MatchProfiler( const QStringList & keywords );
+    ~MatchProfiler();
+
+    void setEnabled( bool enabled ) { this->enabled = enabled ? 1 : 0; }
+    bool isEnabled() const { return enabled; }
+
+    /**
+      Record phase latency of query with keyword at given index, or -1 if it has no keyword
+    */
+    void record( int keyword, Phase phase, qint64 nsecs );
+
+    void reset();
+
+    /**
+      Table of p50/p95/p99 latencies of each phase and keyword, which has queries
+    */
+    QString report() const;
+
+    /**
+      Monotonic time in nanoseconds
+    */
+    static qint64 now();
+
+private:
+
+    static const char * phaseName( Phase phase );
+
+private:
+
+    QStringList keywords;
+    LatencyHistogram * histograms; // By keyword and phase, queries without keyword first
+    QAtomicInt enabled;
+
+    Q_DISABLE_COPY( MatchProfiler )
+};
+
+/**
+  Timing of single query. Each lap is recorded as the given phase, and the
+  whole query is recorded on destruction
+*/
+class QueryProfile {
+public:
+    explicit QueryProfile( MatchProfiler & profiler ) : profiler( profiler ), enabled( profiler.isEnabled() ), keyword( -1 ) {
+        if ( enabled )
+            start = last = MatchProfiler::now();
+    }
+
+    ~QueryProfile() {
+        if ( enabled )
+            profiler.record( keyword, MatchProfiler::Total, MatchProfiler::now() - start );
+    }
+
+    void setKeyword( int index ) { keyword = index; }
+    int keywordIndex() const { return keyword; }
+
+    /**
+      Record time since previous lap as given phase
+    */
+    void lap( MatchProfiler::Phase phase ) {
+        if ( !enabled )
+            return;
+
+        const qint64 time = MatchProfiler::now();
+
+        profiler.record( keyword, phase, time - last );
+        last = time;
+    }
+
+private:
+    MatchProfiler & profiler;
+    const bool enabled;
+    int keyword;
+    qint64 start, last;
+};
+
+#endif
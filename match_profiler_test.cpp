@@ -0,0 +1,73 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "match_profiler_test.h"
+#include "match_profiler.h"
+
+void MatchProfilerTest::testPercentiles() {
+    LatencyHistogram histogram;
+
+    for ( int i = 1; i <= 1000; ++ i )
+        histogram.record( i * 1000 ); // From 1 to 1000 microseconds
+
+    QCOMPARE( histogram.count(), 1000 );
+
+    // Buckets are at most 25% wide
+    QVERIFY( histogram.percentile( 0.5 ) >= 500000 && histogram.percentile( 0.5 ) < 625000 );
+    QVERIFY( histogram.percentile( 0.95 ) >= 950000 && histogram.percentile( 0.95 ) < 1187500 );
+    QVERIFY( histogram.percentile( 0.99 ) >= 990000 && histogram.percentile( 0.99 ) < 1237500 );
+
+    histogram.reset();
+
+    QCOMPARE( histogram.count(), 0 );
+    QCOMPARE( histogram.percentile( 0.5 ), qint64( 0 ) );
+}
+
+void MatchProfilerTest::testDisabled() {
+    MatchProfiler profiler( QStringList() << "events" );
+
+    {
+        QueryProfile profile( profiler );
+        profile.setKeyword( 0 );
+        profile.lap( MatchProfiler::Dispatch );
+    }
+
+    QCOMPARE( profiler.report().count( '\n' ), 1 ); // Only header
+}
+
+void MatchProfilerTest::testReport() {
+    MatchProfiler profiler( QStringList() << "events" << "todos" );
+    profiler.setEnabled( true );
+
+    {
+        QueryProfile profile( profiler );
+        profile.setKeyword( 1 );
+        profile.lap( MatchProfiler::Dispatch );
+        profile.lap( MatchProfiler::Search );
+    }
+
+    const QStringList lines = profiler.report().split( '\n', QString::SkipEmptyParts );
+
+    QCOMPARE( lines.size(), 4 ); // Header, dispatch, search and total
+    QVERIFY( lines[1].startsWith( "todos\tdispatch\t1\t" ) );
+    QVERIFY( lines[3].startsWith( "todos\ttotal\t1\t" ) );
+}
+
+QTEST_MAIN(MatchProfilerTest)
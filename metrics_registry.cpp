@@ -0,0 +1,84 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics_registry.h"
+
+#include <QDateTime>
+#include <QTextStream>
+
+void Metric::touch() {
+    current = QDateTime::currentDateTime().toTime_t();
+}
+
+MetricsRegistry::MetricsRegistry( QObject * parent ) : QObject( parent ) {
+}
+
+MetricsRegistry::~MetricsRegistry() {
+    qDeleteAll( metrics );
+}
+
+Metric * MetricsRegistry::metric( const QString & name, Metric::Kind kind ) {
+    QMutexLocker locker( &mutex );
+
+    Metric * & metric = metrics[ name ];
+
+    if ( !metric )
+        metric = new Metric( kind );
+
+    return metric;
+}
+
+void MetricsRegistry::reset() {
+    emit aboutToReset();
+
+    QMutexLocker locker( &mutex );
+
+    foreach ( Metric * metric, metrics )
+        if ( metric->kind == Metric::Counter )
+            metric->set( 0 );
+}
+
+QString MetricsRegistry::report() {
+    emit aboutToReport();
+
+    QMutexLocker locker( &mutex );
+
+    QString result;
+    QTextStream out( &result );
+
+    const uint now = QDateTime::currentDateTime().toTime_t();
+
+    for ( QMap<QString, Metric *>::const_iterator it = metrics.constBegin(); it != metrics.constEnd(); ++ it ) {
+        out << it.key() << '\t';
+
+        if ( it.value()->kind != Metric::Timestamp )
+            out << it.value()->value();
+        else if ( it.value()->value() == 0 )
+            out << "never";
+        else
+            out << ( now - uint( it.value()->value() ) ) << " s ago";
+
+        out << '\n';
+    }
+
+    out.flush();
+
+    return result;
+}
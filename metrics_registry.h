@@ -0,0 +1,107 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_REGISTRY_H
+#define METRICS_REGISTRY_H
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+
+/**
+  Single named value of the registry. Updating it is lock-free
+*/
+class Metric {
+public:
+    enum Kind {
+        Counter, // Sum of added values, cleared on reset
+        Gauge, // Last set value
+        Timestamp // Time of last event, reported as seconds since it
+    };
+
+public:
+    explicit Metric( Kind kind ) : kind( kind ), current( 0 ) {}
+
+    void add( int value ) { current.fetchAndAddRelaxed( value ); }
+    void set( int value ) { current = value; }
+
+    /**
+      Set timestamp to current time
+    */
+    void touch();
+
+    int value() const { return current; }
+
+private:
+    friend class MetricsRegistry;
+
+    const Kind kind;
+    QAtomicInt current;
+};
+
+/**
+  Registry of runner metrics. Components register their metrics once and
+  keep pointers to them, so recording costs single atomic operation.
+
+  Values which are expensive to keep up to date are sampled by components
+  right before reporting, on aboutToReport().
+*/
+class MetricsRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsRegistry( QObject * parent = 0 );
+    ~MetricsRegistry();
+
+    /**
+      Metric with given name, created on first request. Pointer stays valid
+      for the lifetime of the registry
+    */
+    Metric * metric( const QString & name, Metric::Kind kind );
+
+    Metric * counter( const QString & name ) { return metric( name, Metric::Counter ); }
+    Metric * gauge( const QString & name ) { return metric( name, Metric::Gauge ); }
+    Metric * timestamp( const QString & name ) { return metric( name, Metric::Timestamp ); }
+
+    /**
+      Clear all counters. Components clear sources of their sampled values
+      on aboutToReset()
+    */
+    void reset();
+
+    /**
+      Sample metrics and list them by name
+    */
+    QString report();
+
+signals:
+
+    void aboutToReport();
+    void aboutToReset();
+
+private:
+
+    QMap<QString, Metric *> metrics;
+    mutable QMutex mutex; // Guards map, not the values
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "runner_diagnostics.h"
+#include "match_profiler.h"
+#include "metrics_registry.h"
+
+#include <KDebug>
+
+#include <QDBusConnection>
+#include <QTimer>
+
+static const char objectPath[] = "/EventsRunner";
+
+RunnerDiagnostics::RunnerDiagnostics( MatchProfiler & profiler, MetricsRegistry & metrics, QObject * parent ) : QObject( parent ), profiler( profiler ), metrics( metrics ) {
+    dumpTimer = new QTimer( this );
+
+    connect( dumpTimer, SIGNAL( timeout() ), this, SLOT( dumpReport() ) );
+
+    const int dumpInterval = qgetenv( "EVENTS_RUNNER_PROFILE" ).toInt();
+
+    if ( dumpInterval > 0 ) {
+        profiler.setEnabled( true );
+        dumpTimer->start( dumpInterval * 1000 );
+    }
+}
+
+void RunnerDiagnostics::registerObject() {
+    if ( !QDBusConnection::sessionBus().registerObject( objectPath, this, QDBusConnection::ExportScriptableSlots ) )
+        kDebug() << "Failed to register diagnostics on session bus";
+}
+
+void RunnerDiagnostics::setProfilingEnabled( bool enabled ) {
+    profiler.setEnabled( enabled );
+}
+
+bool RunnerDiagnostics::isProfilingEnabled() const {
+    return profiler.isEnabled();
+}
+
+QString RunnerDiagnostics::profileReport() const {
+    return profiler.report();
+}
+
+void RunnerDiagnostics::resetProfile() {
+    profiler.reset();
+}
+
+QString RunnerDiagnostics::metricsReport() const {
+    return metrics.report();
+}
+
+void RunnerDiagnostics::resetMetrics() {
+    metrics.reset();
+}
+
+void RunnerDiagnostics::dumpReport() {
+    kDebug() << "Match profile:\n" << qPrintable( profiler.report() );
+    kDebug() << "Metrics:\n" << qPrintable( metrics.report() );
+}
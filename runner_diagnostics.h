@@ -0,0 +1,77 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RUNNER_DIAGNOSTICS_H
+#define RUNNER_DIAGNOSTICS_H
+
+#include <QObject>
+
+class MatchProfiler;
+class MetricsRegistry;
+class QTimer;
+
+/**
+  Runtime diagnostics of the runner: match profile and metrics, exported on
+  the session bus of the process hosting it. Profiling may also be enabled at
+  startup by setting EVENTS_RUNNER_PROFILE to the interval of report dumps
+  in seconds.
+*/
+class RunnerDiagnostics : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO( "D-Bus Interface", "org.kde.plasma.runner.events.Diagnostics" )
+
+public:
+    RunnerDiagnostics( MatchProfiler & profiler, MetricsRegistry & metrics, QObject * parent );
+
+    /**
+      Export diagnostics on the session bus
+    */
+    void registerObject();
+
+public slots:
+
+    Q_SCRIPTABLE void setProfilingEnabled( bool enabled );
+    Q_SCRIPTABLE bool isProfilingEnabled() const;
+
+    /**
+      Latency percentiles of match phases per keyword
+    */
+    Q_SCRIPTABLE QString profileReport() const;
+    Q_SCRIPTABLE void resetProfile();
+
+    /**
+      Current values of cache, fetch and query metrics
+    */
+    Q_SCRIPTABLE QString metricsReport() const;
+    Q_SCRIPTABLE void resetMetrics();
+
+private slots:
+
+    void dumpReport();
+
+private:
+
+    MatchProfiler & profiler;
+    MetricsRegistry & metrics;
+    QTimer * dumpTimer;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ *   Copyright (C) 2010 Alexey Noskov <alexey.noskov@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License as
+ *   published by the Free Software Foundation; either version 2 of
+ *   the License or (at your option) version 3 or any later version
+ *   accepted by the membership of KDE e.V. (or its successor approved
+ *   by the membership of KDE e.V.), which shall act as a proxy
+ *   defined in Section 14 of version 3 of the license.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+#include <algorithm>
+
+/**
+  Bounded selection of values with the highest scores in a single pass.
+  Keeps min-heap of at most limit entries, so adding costs O(log limit)
+*/
+template <typename T>
+class TopK {
+public:
+    explicit TopK( int limit ) : limit( limit ) {
+        entries.reserve( limit );
+    }
+
+    /**
+      Check if value with given score would be selected, to skip preparing it otherwise
+    */
+    bool accepts( qreal score ) const {
+        return entries.size() < limit || entries.first().score < score;
+    }
+
+    void add( qreal score, const T & value ) {
+        if ( !accepts( score ) )
+            return;
+
+        Entry entry = { score, value };
+
+        if ( entries.size() == limit ) { // Replace the lowest one
+            std::pop_heap( entries.begin(), entries.end() );
+            entries.last() = entry;
+        } else {
+            entries.append( entry );
+        }
+
+        std::push_heap( entries.begin(), entries.end() );
+    }
+
+    /**
+      Selected values with their scores, best first
+    */
+    QList< QPair<qreal, T> > results() const {
+        QVector<Entry> sorted = entries;
+        QList< QPair<qreal, T> > result;
+
+        std::sort_heap( sorted.begin(), sorted.end() );
+
+        foreach ( const Entry & entry, sorted )
+            result.append( qMakePair( entry.score, entry.value ) );
+
+        return result;
+    }
+
+private:
+
+    struct Entry {
+        qreal score;
+        T value;
+
+        bool operator<( const Entry & other ) const {
+            return score > other.score; // Inverted, so the lowest score is on top of the heap
+        }
+    };
+
+private:
+
+    int limit;
+    QVector<Entry> entries;
+};
+
+#endif